@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t kBufferAlignment = 64;
+
+inline size_t AlignUp(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+// Zero-initialised byte buffer aligned to kBufferAlignment. With huge pages
+// enabled, buffers of at least one huge page are mapped directly and advised
+// to the kernel as huge-page candidates where the platform supports it. Every
+// allocation is counted towards GetMemoryUsage.
+class AlignedBuffer {
+public:
+    AlignedBuffer() = default;
+    explicit AlignedBuffer(size_t size);
+    ~AlignedBuffer();
+
+    AlignedBuffer(const AlignedBuffer& other);
+    AlignedBuffer& operator=(const AlignedBuffer& other);
+    AlignedBuffer(AlignedBuffer&& other) noexcept;
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept;
+
+    uint8_t* Data();
+    const uint8_t* Data() const;
+    size_t Size() const;
+
+private:
+    void Release();
+
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+};
+
+void SetHugePageAllocation(bool enabled);
+
+// Bytes a buffer of `size` bytes takes, and is counted as, under the current
+// huge-page setting: huge-page mappings are rounded up to whole pages.
+size_t AllocatedBytes(size_t size);
+
+// Bytes held by all live AlignedBuffers, and the highest value seen.
+struct MemoryUsage {
+    size_t current = 0;
+    size_t peak = 0;
+};
+
+MemoryUsage GetMemoryUsage();
\ No newline at end of file
@@ -4,5 +4,6 @@
 
 #include "image.h"
 
-Image ReadBmp(const std::string& path);
+Image ReadBmp(const std::string& path, PixelLayout layout = PixelLayout::Packed, int border = 0);
+void ReadBmpSize(const std::string& path, int& width, int& height);
 void WriteBmp(const std::string& path, const Image& image);
\ No newline at end of file
@@ -5,5 +5,32 @@
 class Filter {
 public:
     virtual ~Filter() = default;
+
+    // Radius of the neighbourhood read around each output pixel. The pipeline
+    // prepares at least this much border on the image before calling Apply.
+    virtual int GetHalo() const { return 0; }
+
+    // True when each output pixel depends only on input pixels within
+    // GetHalo() and the image size is unchanged. Such filters may be handed a
+    // tile of the image instead of the whole frame.
+    virtual bool IsLocal() const { return false; }
+
+    // Pixel layout the filter runs fastest on, and whether Apply accepts a
+    // given layout. The pipeline converts the image only when the current
+    // layout is not supported.
+    virtual PixelLayout GetPreferredLayout() const { return PixelLayout::Packed; }
+    virtual bool SupportsLayout(PixelLayout layout) const { return layout == GetPreferredLayout(); }
+
+    // Full-size images Apply holds at its peak besides the input; 0 means
+    // the filter works in place. Used to plan runs under a memory budget.
+    virtual int GetTemporaryImages() const { return 1; }
+
     virtual void Apply(Image& image) const = 0;
+
+    // Whole-image runs go through here with the pipeline's thread budget.
+    // Filters that split their own work across threads override it.
+    virtual void ApplyParallel(Image& image, int threads) const {
+        (void)threads;
+        Apply(image);
+    }
 };
\ No newline at end of file
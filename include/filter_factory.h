@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "filter.h"
+#include "pipeline.h"
 
-std::vector<std::unique_ptr<Filter>> ParseFilters(const std::vector<std::string>& args, size_t start_index);
+std::vector<std::unique_ptr<Filter>> ParseFilters(const std::vector<std::string>& args, size_t start_index, PipelineOptions& options);
 void PrintUsage(const std::string& exe);
\ No newline at end of file
@@ -4,4 +4,12 @@
 
 #include "filter.h"
 
-std::unique_ptr<Filter> MakeBlur(double sigma);
\ No newline at end of file
+// Fir convolves with the sampled Gaussian; Recursive runs a third-order
+// Young-van Vliet IIR approximation whose cost does not grow with sigma. It
+// is too coarse below sigma 3, where MakeBlur uses Fir regardless.
+enum class BlurVariant {
+    Fir,
+    Recursive,
+};
+
+std::unique_ptr<Filter> MakeBlur(double sigma, BlurVariant variant = BlurVariant::Fir);
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <memory>
+
+#include "filter.h"
+
+// Canny edges of the luma: Gaussian blur, Sobel gradient, non-maximum
+// suppression and hysteresis. lo and hi are gradient magnitudes relative to
+// a black-to-white step. Output is white edges on black.
+std::unique_ptr<Filter> MakeCanny(double sigma, double lo, double hi);
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "filter.h"
+
+std::unique_ptr<Filter> MakeConvolution(int size, std::vector<double> taps);
\ No newline at end of file
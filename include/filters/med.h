@@ -4,4 +4,13 @@
 
 #include "filter.h"
 
-std::unique_ptr<Filter> MakeMedian(int radius);
\ No newline at end of file
+// Select partitions each window with nth_element. Network is a fixed
+// 19-exchange sorting network and needs radius 1. Histogram keeps a sliding
+// 256-bin histogram per row, so its cost grows with the radius, not its square.
+enum class MedianVariant {
+    Select,
+    Network,
+    Histogram,
+};
+
+std::unique_ptr<Filter> MakeMedian(int radius, MedianVariant variant = MedianVariant::Select);
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Bounded blocking FIFO shared between the stages of a frame stream. Push
+// blocks while the queue is full, Pop while it is empty. After Close, Push
+// fails and Pop drains what is left before failing.
+template <typename T>
+class FrameQueue {
+public:
+    explicit FrameQueue(size_t capacity) : capacity_(capacity) {}
+
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mu_);
+        not_full_.wait(lock, [&] { return closed_ || items_.size() < capacity_; });
+        if (closed_) return false;
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mu_);
+        not_empty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mu_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    std::mutex mu_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_ = false;
+};
\ No newline at end of file
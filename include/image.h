@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <vector>
+
+#include "aligned_buffer.h"
 
 struct Pixel {
     uint8_t r{};
@@ -9,22 +11,85 @@ struct Pixel {
     uint8_t b{};
 };
 
+enum class BorderMode {
+    Clamp,
+    Mirror,
+    Wrap,
+};
+
+// Packed keeps interleaved RGB pixels. Planar keeps one 64-byte aligned plane
+// per channel whose rows start aligned and are padded to a multiple of 64.
+enum class PixelLayout {
+    Packed,
+    Planar,
+};
+
+// Pixels live in a buffer padded by `border` pixels on every side (the apron).
+// PrepareBorder refills the apron from the interior according to the border
+// mode, after which stencils may read up to `border` pixels past any edge.
 class Image {
 public:
     Image() = default;
-    Image(int width, int height);
+    Image(int width, int height, int border = 0, BorderMode mode = BorderMode::Clamp,
+          PixelLayout layout = PixelLayout::Packed);
 
     int GetWidth() const;
     int GetHeight() const;
+    int GetBorder() const;
+    int GetStride() const;
+
+    BorderMode GetBorderMode() const;
+    void SetBorderMode(BorderMode mode);
+
+    PixelLayout GetLayout() const;
+    void ConvertTo(PixelLayout layout);
 
     Pixel GetPixel(int x, int y) const;
     void SetPixel(int x, int y, Pixel p);
 
-    std::vector<Pixel>& Data();
-    const std::vector<Pixel>& Data() const;
+    // Packed only: pointer to pixel (0, y); y and the index may range into
+    // the apron.
+    Pixel* Row(int y);
+    const Pixel* Row(int y) const;
+
+    // Planar only: pointer to channel c (0 = r, 1 = g, 2 = b) of pixel (0, y).
+    uint8_t* PlaneRow(int c, int y);
+    const uint8_t* PlaneRow(int c, int y) const;
+
+    void PrepareBorder(int radius);
+
+    // Copies a width x height block from src at (sx, sy) to (dx, dy).
+    void CopyRect(const Image& src, int sx, int sy, int dx, int dy, int width, int height);
+
+    // Re-initialises the image to a new geometry on its existing buffer if
+    // that is large enough, and returns false, changing nothing, otherwise.
+    // Pixel values after a reshape are unspecified.
+    bool Reshape(int width, int height, int border, BorderMode mode, PixelLayout layout);
+
+    // Bytes of pixel storage held, which may exceed what the geometry needs
+    // after a Reshape.
+    size_t GetCapacity() const;
+
+    // Bytes of pixel storage an image of this geometry needs, and what
+    // allocating them costs.
+    static size_t StorageBytes(int width, int height, int border, PixelLayout layout);
+    static size_t EstimateBytes(int width, int height, int border, PixelLayout layout);
 
 private:
+    void SetGeometry(int width, int height, int border, BorderMode mode, PixelLayout layout);
+    size_t BufferBytes() const;
+    size_t Index(int x, int y) const;
+    size_t PlaneIndex(int c, int x, int y) const;
+    void CheckRange(int x, int y) const;
+
     int width_ = 0;
     int height_ = 0;
-    std::vector<Pixel> data_;
+    int border_ = 0;
+    BorderMode mode_ = BorderMode::Clamp;
+    PixelLayout layout_ = PixelLayout::Packed;
+
+    size_t plane_left_ = 0;
+    size_t plane_stride_ = 0;
+    size_t plane_size_ = 0;
+    AlignedBuffer data_;
 };
\ No newline at end of file
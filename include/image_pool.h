@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "image.h"
+
+// Free image buffers kept for reuse, so a chain run frame after frame stops
+// allocating (and zero-filling) a full-size image per stage. Acquire reshapes
+// the smallest free buffer that is large enough; when none is, it drops them
+// all before allocating, so nothing is allocated while an idle buffer could
+// have served. Not thread-safe: one pool per thread at a time.
+class ImagePool {
+public:
+    Image Acquire(int width, int height, int border, BorderMode mode, PixelLayout layout);
+    void Release(Image image);
+    void Clear();
+
+    // Bytes held by free buffers.
+    size_t GetIdleBytes() const;
+
+    // Installs a pool as the calling thread's current one until destroyed.
+    // A null pool makes AcquireImage allocate.
+    class Scope {
+    public:
+        explicit Scope(ImagePool* pool);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ImagePool* previous_;
+    };
+
+private:
+    std::vector<Image> free_;
+};
+
+// Filter scratch and output images: taken from the current pool, if any.
+// Pixel values are unspecified.
+Image AcquireImage(int width, int height, int border, BorderMode mode, PixelLayout layout);
+
+// Hands an image no longer needed to the current pool, or frees it.
+void RecycleImage(Image image);
+
+// Replaces `image` with `next` and recycles the old buffer.
+void ReplaceImage(Image& image, Image next);
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Calls task(i) for every i in [0, count) on up to `threads` threads, the
+// calling one included. Indices are handed out one at a time, so uneven work
+// balances itself. The first exception stops the remaining work and is
+// rethrown once all threads have finished.
+template <typename Task>
+void ParallelFor(size_t count, int threads, Task&& task) {
+    std::atomic<size_t> next{0};
+    std::mutex error_mu;
+    std::exception_ptr error;
+    auto worker = [&] {
+        for (size_t k = next++; k < count; k = next++) {
+            try {
+                task(k);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mu);
+                if (!error) error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+
+    const size_t workers = std::min(count, static_cast<size_t>(std::max(threads, 1)));
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+    if (error) std::rethrow_exception(error);
+}
\ No newline at end of file
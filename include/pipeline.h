@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "filter.h"
+#include "image_pool.h"
+#include "tuning.h"
+
+struct PipelineOptions {
+    BorderMode border = BorderMode::Clamp;
+    bool fuse = true;
+    int tile_size = 0;
+    bool huge_pages = false;
+    int threads = 0;
+    size_t max_memory = 0;
+    TuningProfile tuning;
+};
+
+// Runs the filters in order. Consecutive local filters are fused: the image
+// is processed tile by tile, each tile extended by the summed halo of the
+// chain so every stage reads only cache-resident data. A run stops growing
+// once its halo would make a tile recompute more than half as many pixels
+// again as it writes. A tile_size of 0 picks a size that fits the L2 cache. Tiles are spread over `threads` workers, 0
+// meaning one per hardware thread; whole-image filters get the same budget
+// through Filter::ApplyParallel. With max_memory set, each run falls back
+// to fewer threads, whole-image or in-place banded execution until its
+// estimated peak fits, and throws when none does.
+//
+// Stage outputs and temporaries are swapped through `pool`, or a pool local
+// to the call. Passing the same pool for every frame of a stream lets the
+// buffers released by one frame carry the next.
+void RunPipeline(Image& image, const std::vector<std::unique_ptr<Filter>>& filters, const PipelineOptions& options,
+                 ImagePool* pool = nullptr);
+
+// Layout to decode the input into: the preference of the first stencil
+// filter, so packed/planar conversion normally happens only in the codec.
+PixelLayout ChooseInputLayout(const std::vector<std::unique_ptr<Filter>>& filters);
+
+// Border to allocate the input with so no stage has to grow it.
+int ChooseInputBorder(const std::vector<std::unique_ptr<Filter>>& filters);
+
+// Estimated peak image memory of running the chain on a width x height
+// input with the strategies RunPipeline would pick under options.max_memory.
+size_t EstimatePeakBytes(int width, int height, const std::vector<std::unique_ptr<Filter>>& filters,
+                         const PipelineOptions& options);
+
+// Throws with the estimated requirement if the chain cannot run on a
+// width x height input within options.max_memory.
+void CheckMemoryBudget(int width, int height, const std::vector<std::unique_ptr<Filter>>& filters,
+                       const PipelineOptions& options);
+
+// Prints the peak image memory seen so far to stderr.
+void ReportMemoryUsage(const PipelineOptions& options);
\ No newline at end of file
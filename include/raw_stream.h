@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "filter.h"
+#include "pipeline.h"
+
+// Parses "<width>x<height>".
+void ParseFrameSize(const std::string& s, int& width, int& height);
+
+// Reads packed RGB24 frames of the given size from `in` until end of input,
+// runs the filters on each and writes the results to `out`. Reading, filtering
+// and writing run concurrently on a small pool of recycled frames.
+void RunRawStream(std::FILE* in, std::FILE* out, int width, int height,
+                  const std::vector<std::unique_ptr<Filter>>& filters, const PipelineOptions& options);
\ No newline at end of file
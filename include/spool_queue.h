@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "filter.h"
+#include "pipeline.h"
+
+// Longest lease accepted, a week; it also keeps the heartbeat interval
+// representable.
+constexpr double kMaxLeaseSeconds = 7 * 24 * 3600.0;
+
+// Parses a positive number of seconds, at most kMaxLeaseSeconds.
+double ParseLeaseSeconds(const std::string& s);
+
+// A spool directory shared by any number of workers, on one or many hosts:
+//   incoming/  BMP jobs; producers should write elsewhere (or to a dot-file)
+//              and rename them in
+//   work/      claimed jobs, renamed to <job>~<worker>, each next to a
+//              <job>~<worker>.lease that its worker touches while alive
+//   done/      outputs, renamed into place once complete
+//   failed/    inputs that could not be processed, with a <job>.error note
+// A lease untouched for lease_seconds marks a dead worker, and any worker
+// puts that job back into incoming/ unless a job of the same name has been
+// submitted since; then it is retried on a later pass. Lease expiry compares file times written
+// by different hosts, so lease_seconds must dwarf their clock skew.
+//
+// Processes jobs until incoming/ and work/ are both empty, then returns the
+// number of jobs this worker failed.
+int RunQueueWorker(const std::string& dir, double lease_seconds, const std::vector<std::unique_ptr<Filter>>& filters,
+                   const PipelineOptions& options);
\ No newline at end of file
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "image_pool.h"
+
+static_assert(sizeof(Pixel) == 3, "stencil engine expects packed RGB pixels");
+
+// Kernels are square, odd-sized and stored row-major. A kernel type exposes
+// `Value`, `kSize` and `At(i)`; kSize > 0 fixes the size at compile time so
+// the tap loop is fully unrolled (and zero taps of a constexpr kernel vanish),
+// kSize == 0 means the size is only known at runtime through `Size()`.
+template <typename T, int N>
+struct FixedKernel {
+    static_assert(N > 0 && N % 2 == 1, "kernel size must be odd");
+
+    using Value = T;
+    static constexpr int kSize = N;
+
+    static constexpr int Size() { return N; }
+    constexpr T At(int i) const { return taps[i]; }
+
+    T taps[N * N]{};
+};
+
+template <typename T>
+struct DynamicKernel {
+    using Value = T;
+    static constexpr int kSize = 0;
+
+    int Size() const { return size; }
+    T At(int i) const { return taps[static_cast<size_t>(i)]; }
+
+    int size = 1;
+    std::vector<T> taps{T{1}};
+};
+
+namespace stencil_detail {
+
+template <typename Kernel, typename F, size_t... I>
+inline void ForEachTapFixed(const Kernel& k, F& f, std::index_sequence<I...>) {
+    constexpr int n = Kernel::kSize;
+    (f(static_cast<int>(I) / n - n / 2, static_cast<int>(I) % n - n / 2, k.At(static_cast<int>(I))), ...);
+}
+
+template <typename Kernel, typename F>
+inline void ForEachTap(const Kernel& k, F&& f) {
+    if constexpr (Kernel::kSize > 0) {
+        ForEachTapFixed(k, f, std::make_index_sequence<static_cast<size_t>(Kernel::kSize * Kernel::kSize)>{});
+    } else {
+        const int n = k.Size();
+        for (int i = 0; i < n * n; ++i) f(i / n - n / 2, i % n - n / 2, k.At(i));
+    }
+}
+
+}  // namespace stencil_detail
+
+inline void RequireBorder(const Image& img, int radius) {
+    if (img.GetBorder() < radius) throw std::logic_error("image border is smaller than the stencil radius");
+}
+
+// Adds wgt * src[i] to acc[i] for i in [0, n) over channel bytes.
+template <typename T>
+inline void AccumulateRow(T* acc, const uint8_t* src, T wgt, size_t n) {
+    for (size_t i = 0; i < n; ++i) acc[i] += wgt * static_cast<T>(src[i]);
+}
+
+// Stencils see an image as channel rows: one interleaved row of 3 * width
+// bytes for packed images, or one row of width bytes per plane for planar
+// ones. Horizontally adjacent samples of a channel are SampleStep bytes apart.
+inline int ChannelRowCount(const Image& img) {
+    return img.GetLayout() == PixelLayout::Packed ? 1 : 3;
+}
+
+inline int SampleStep(const Image& img) {
+    return img.GetLayout() == PixelLayout::Packed ? 3 : 1;
+}
+
+inline const uint8_t* ChannelRow(const Image& img, int c, int y, int x) {
+    if (img.GetLayout() == PixelLayout::Packed) return reinterpret_cast<const uint8_t*>(img.Row(y) + x);
+    return img.PlaneRow(c, y) + x;
+}
+
+inline uint8_t* ChannelRow(Image& img, int c, int y, int x) {
+    if (img.GetLayout() == PixelLayout::Packed) return reinterpret_cast<uint8_t*>(img.Row(y) + x);
+    return img.PlaneRow(c, y) + x;
+}
+
+// Writes row y of `out` from channel-row sums laid out like ChannelRow.
+template <typename T, typename Finish>
+inline void StoreRow(Image& out, int y, const T* acc, size_t len, Finish& finish) {
+    const int w = out.GetWidth();
+    if (out.GetLayout() == PixelLayout::Packed) {
+        Pixel* d = out.Row(y);
+        for (int x = 0; x < w; ++x) {
+            const size_t i = static_cast<size_t>(x) * 3;
+            d[x] = finish(acc[i], acc[i + 1], acc[i + 2]);
+        }
+        return;
+    }
+    uint8_t* r = out.PlaneRow(0, y);
+    uint8_t* g = out.PlaneRow(1, y);
+    uint8_t* b = out.PlaneRow(2, y);
+    for (int x = 0; x < w; ++x) {
+        const size_t i = static_cast<size_t>(x);
+        const Pixel p = finish(acc[i], acc[len + i], acc[2 * len + i]);
+        r[x] = p.r;
+        g[x] = p.g;
+        b[x] = p.b;
+    }
+}
+
+// Applies `k` to every channel of `src` and maps the three weighted sums of
+// each pixel through `finish(r, g, b) -> Pixel`. `src` must carry a prepared
+// border of at least the kernel radius, so taps are read straight from the
+// apron without any clamping. Works on both pixel layouts.
+template <typename Kernel, typename Finish>
+Image ApplyStencil(const Image& src, const Kernel& k, Finish finish) {
+    using T = typename Kernel::Value;
+
+    const int w = src.GetWidth();
+    const int h = src.GetHeight();
+    const int r = k.Size() / 2;
+    RequireBorder(src, r);
+
+    Image out = AcquireImage(w, h, src.GetBorder(), src.GetBorderMode(), src.GetLayout());
+    if (w == 0 || h == 0) return out;
+
+    const int rows = ChannelRowCount(src);
+    const int step = SampleStep(src);
+    const size_t len = static_cast<size_t>(w) * static_cast<size_t>(step);
+    std::vector<T> acc(len * static_cast<size_t>(rows));
+    for (int y = 0; y < h; ++y) {
+        std::fill(acc.begin(), acc.end(), T{});
+        for (int c = 0; c < rows; ++c) {
+            T* a = acc.data() + static_cast<size_t>(c) * len;
+            stencil_detail::ForEachTap(k, [&](int dy, int dx, T wgt) {
+                if (wgt == T{}) return;
+                AccumulateRow(a, ChannelRow(src, c, y + dy, dx), wgt, len);
+            });
+        }
+        StoreRow(out, y, acc.data(), len, finish);
+    }
+
+    return out;
+}
+
+// Separable variant: the kernel is col_k (vertical) times row_k (horizontal),
+// both of the same odd length. Horizontally filtered rows are kept in a ring
+// of n rows so each source row is filtered once.
+template <typename T, typename Finish>
+Image ApplySeparableStencil(const Image& src, const std::vector<T>& row_k, const std::vector<T>& col_k, Finish finish) {
+    const int w = src.GetWidth();
+    const int h = src.GetHeight();
+    const int n = static_cast<int>(row_k.size());
+    const int r = n / 2;
+    RequireBorder(src, r);
+
+    Image out = AcquireImage(w, h, src.GetBorder(), src.GetBorderMode(), src.GetLayout());
+    if (w == 0 || h == 0) return out;
+
+    const int rows = ChannelRowCount(src);
+    const int step = SampleStep(src);
+    const size_t len = static_cast<size_t>(w) * static_cast<size_t>(step);
+    const size_t row_size = len * static_cast<size_t>(rows);
+
+    std::vector<T> ring(row_size * static_cast<size_t>(n));
+    auto slot = [&](int sy) {
+        return ring.data() + static_cast<size_t>(((sy % n) + n) % n) * row_size;
+    };
+    auto filter_row = [&](int sy) {
+        T* acc = slot(sy);
+        std::fill(acc, acc + row_size, T{});
+        for (int c = 0; c < rows; ++c) {
+            for (int i = -r; i <= r; ++i) {
+                const T wgt = row_k[static_cast<size_t>(i + r)];
+                if (wgt == T{}) continue;
+                AccumulateRow(acc + static_cast<size_t>(c) * len, ChannelRow(src, c, sy, i), wgt, len);
+            }
+        }
+    };
+
+    std::vector<T> acc(row_size);
+    int filtered = -r - 1;
+    for (int y = 0; y < h; ++y) {
+        while (filtered < y + r) filter_row(++filtered);
+
+        std::fill(acc.begin(), acc.end(), T{});
+        for (int j = -r; j <= r; ++j) {
+            const T wgt = col_k[static_cast<size_t>(j + r)];
+            if (wgt == T{}) continue;
+            const T* row = slot(y + j);
+            T* a = acc.data();
+            for (size_t i = 0; i < row_size; ++i) a[i] += wgt * row[i];
+        }
+
+        StoreRow(out, y, acc.data(), len, finish);
+    }
+
+    return out;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "filters/blur.h"
+#include "filters/med.h"
+
+struct PipelineOptions;
+
+// Per-host choices measured by `--tune`. Zero means "no preference": the
+// pipeline defaults for threads and tile size, and the baseline kernel for
+// the variant thresholds.
+struct TuningProfile {
+    int threads = 0;
+    int tile_size = 0;
+    double recursive_blur_min_sigma = 0.0;
+    bool network_median = false;
+    int histogram_median_min_radius = 0;
+};
+
+BlurVariant ChooseBlurVariant(const TuningProfile& profile, double sigma);
+MedianVariant ChooseMedianVariant(const TuningProfile& profile, int radius);
+
+// $IMAGECRAFT_PROFILE if set (empty disables profiles), otherwise
+// ~/.imagecraft/<hostname>.profile.
+std::string TuningProfilePath();
+
+// Reads a profile into options.tuning and uses its thread count and tile size
+// as defaults. Returns false, leaving options untouched, if there is no
+// profile; a malformed one is reported on stderr and ignored.
+bool LoadTuningProfile(const std::string& path, PipelineOptions& options);
+
+void SaveTuningProfile(const std::string& path, const TuningProfile& profile);
+
+// Benchmarks thread counts, tile sizes and kernel variants on a synthetic
+// width x height image, prints the timings and saves the winners to `path`.
+void RunTuner(int width, int height, const std::string& path);
\ No newline at end of file
@@ -21,12 +21,6 @@ inline double Luma01(const Pixel& p) {
     return (0.299 * p.r + 0.587 * p.g + 0.114 * p.b) / 255.0;
 }
 
-inline Pixel GetClamped(const Image& img, int x, int y) {
-    x = ClampInt(x, 0, img.GetWidth() - 1);
-    y = ClampInt(y, 0, img.GetHeight() - 1);
-    return img.GetPixel(x, y);
-}
-
 inline std::vector<double> GaussianKernel1D(double sigma) {
     if (sigma <= 0.0) {
         return {1.0};
@@ -0,0 +1,122 @@
+#include "aligned_buffer.h"
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+static constexpr size_t kHugePageBytes = size_t{2} << 20;
+
+static bool g_huge_pages = false;
+static std::atomic<size_t> g_current_bytes{0};
+static std::atomic<size_t> g_peak_bytes{0};
+
+static void CountAllocation(size_t bytes) {
+    const size_t now = g_current_bytes.fetch_add(bytes) + bytes;
+    size_t peak = g_peak_bytes.load();
+    while (now > peak && !g_peak_bytes.compare_exchange_weak(peak, now)) {
+    }
+}
+
+static void CountRelease(size_t bytes) {
+    g_current_bytes.fetch_sub(bytes);
+}
+
+void SetHugePageAllocation(bool enabled) {
+    g_huge_pages = enabled;
+}
+
+static bool UseHugePages(size_t size) {
+#if defined(__unix__) || defined(__APPLE__)
+    return g_huge_pages && size >= kHugePageBytes;
+#else
+    (void)size;
+    return false;
+#endif
+}
+
+size_t AllocatedBytes(size_t size) {
+    if (size == 0) return 0;
+    return AlignUp(size, UseHugePages(size) ? kHugePageBytes : kBufferAlignment);
+}
+
+MemoryUsage GetMemoryUsage() {
+    return MemoryUsage{g_current_bytes.load(), g_peak_bytes.load()};
+}
+
+AlignedBuffer::AlignedBuffer(size_t size) : size_(size) {
+    if (size_ == 0) return;
+
+#if defined(__unix__) || defined(__APPLE__)
+    if (UseHugePages(size_)) {
+        void* p = mmap(nullptr, AllocatedBytes(size_), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+#if defined(MADV_HUGEPAGE)
+            madvise(p, AllocatedBytes(size_), MADV_HUGEPAGE);
+#endif
+            data_ = static_cast<uint8_t*>(p);
+            mapped_ = true;
+            CountAllocation(AllocatedBytes(size_));
+            return;
+        }
+    }
+#endif
+
+    data_ = static_cast<uint8_t*>(::operator new(AlignUp(size_, kBufferAlignment), std::align_val_t{kBufferAlignment}));
+    std::memset(data_, 0, size_);
+    CountAllocation(AlignUp(size_, kBufferAlignment));
+}
+
+AlignedBuffer::~AlignedBuffer() {
+    Release();
+}
+
+AlignedBuffer::AlignedBuffer(const AlignedBuffer& other) : AlignedBuffer(other.size_) {
+    if (size_ != 0) std::memcpy(data_, other.data_, size_);
+}
+
+AlignedBuffer& AlignedBuffer::operator=(const AlignedBuffer& other) {
+    if (this != &other) {
+        AlignedBuffer copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+    , mapped_(std::exchange(other.mapped_, false)) {}
+
+AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other) noexcept {
+    if (this != &other) {
+        Release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        mapped_ = std::exchange(other.mapped_, false);
+    }
+    return *this;
+}
+
+uint8_t* AlignedBuffer::Data() { return data_; }
+const uint8_t* AlignedBuffer::Data() const { return data_; }
+size_t AlignedBuffer::Size() const { return size_; }
+
+void AlignedBuffer::Release() {
+    if (!data_) return;
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped_) {
+        munmap(data_, AlignUp(size_, kHugePageBytes));
+        CountRelease(AlignUp(size_, kHugePageBytes));
+        data_ = nullptr;
+        return;
+    }
+#endif
+    ::operator delete(data_, std::align_val_t{kBufferAlignment});
+    CountRelease(AlignUp(size_, kBufferAlignment));
+    data_ = nullptr;
+}
\ No newline at end of file
@@ -44,10 +44,14 @@ static void WriteI32(std::ostream& out, int32_t v) {
     WriteU32(out, static_cast<uint32_t>(v));
 }
 
-Image ReadBmp(const std::string& path) {
-    std::ifstream in(path, std::ios::binary);
-    if (!in) throw std::runtime_error("cannot open input file");
-
+struct BmpHeader {
+    uint32_t data_offset = 0;
+    int width = 0;
+    int height = 0;
+    bool top_down = false;
+};
+
+static BmpHeader ReadHeader(std::istream& in) {
     char sig[2]{};
     in.read(sig, 2);
     if (sig[0] != 'B' || sig[1] != 'M') throw std::runtime_error("not a BMP file");
@@ -76,13 +80,35 @@ Image ReadBmp(const std::string& path) {
     if (compression != 0) throw std::runtime_error("compressed BMP is not supported");
     if (width <= 0 || height_raw == 0) throw std::runtime_error("invalid BMP size");
 
-    const bool top_down = (height_raw < 0);
-    const int height = top_down ? -height_raw : height_raw;
+    BmpHeader header;
+    header.data_offset = data_offset;
+    header.width = width;
+    header.top_down = (height_raw < 0);
+    header.height = header.top_down ? -height_raw : height_raw;
+    return header;
+}
+
+void ReadBmpSize(const std::string& path, int& width, int& height) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open input file");
+    const BmpHeader header = ReadHeader(in);
+    width = header.width;
+    height = header.height;
+}
+
+Image ReadBmp(const std::string& path, PixelLayout layout, int border) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open input file");
+
+    const BmpHeader header = ReadHeader(in);
+    const int width = header.width;
+    const int height = header.height;
+    const bool top_down = header.top_down;
 
-    in.seekg(static_cast<std::streamoff>(data_offset), std::ios::beg);
+    in.seekg(static_cast<std::streamoff>(header.data_offset), std::ios::beg);
     if (!in) throw std::runtime_error("invalid BMP offset");
 
-    Image img(width, height);
+    Image img(width, height, border, BorderMode::Clamp, layout);
 
     const int row_bytes = width * 3;
     const int padding = (4 - (row_bytes % 4)) % 4;
@@ -94,11 +120,23 @@ Image ReadBmp(const std::string& path) {
         in.read(reinterpret_cast<char*>(row.data()), row_bytes);
         if (!in) throw std::runtime_error("unexpected end of file");
 
-        for (int x = 0; x < width; ++x) {
-            const uint8_t b = row[static_cast<size_t>(x * 3 + 0)];
-            const uint8_t g = row[static_cast<size_t>(x * 3 + 1)];
-            const uint8_t r = row[static_cast<size_t>(x * 3 + 2)];
-            img.SetPixel(x, dst_y, Pixel{r, g, b});
+        if (layout == PixelLayout::Planar) {
+            uint8_t* pr = img.PlaneRow(0, dst_y);
+            uint8_t* pg = img.PlaneRow(1, dst_y);
+            uint8_t* pb = img.PlaneRow(2, dst_y);
+            for (int x = 0; x < width; ++x) {
+                pb[x] = row[static_cast<size_t>(x * 3 + 0)];
+                pg[x] = row[static_cast<size_t>(x * 3 + 1)];
+                pr[x] = row[static_cast<size_t>(x * 3 + 2)];
+            }
+        } else {
+            Pixel* dst = img.Row(dst_y);
+            for (int x = 0; x < width; ++x) {
+                const uint8_t b = row[static_cast<size_t>(x * 3 + 0)];
+                const uint8_t g = row[static_cast<size_t>(x * 3 + 1)];
+                const uint8_t r = row[static_cast<size_t>(x * 3 + 2)];
+                dst[x] = Pixel{r, g, b};
+            }
         }
 
         if (padding) {
@@ -148,11 +186,22 @@ void WriteBmp(const std::string& path, const Image& image) {
     const uint8_t pad[3]{0, 0, 0};
 
     for (int y = height - 1; y >= 0; --y) {
-        for (int x = 0; x < width; ++x) {
-            const Pixel p = image.GetPixel(x, y);
-            row[static_cast<size_t>(x * 3 + 0)] = p.b;
-            row[static_cast<size_t>(x * 3 + 1)] = p.g;
-            row[static_cast<size_t>(x * 3 + 2)] = p.r;
+        if (image.GetLayout() == PixelLayout::Planar) {
+            const uint8_t* pr = image.PlaneRow(0, y);
+            const uint8_t* pg = image.PlaneRow(1, y);
+            const uint8_t* pb = image.PlaneRow(2, y);
+            for (int x = 0; x < width; ++x) {
+                row[static_cast<size_t>(x * 3 + 0)] = pb[x];
+                row[static_cast<size_t>(x * 3 + 1)] = pg[x];
+                row[static_cast<size_t>(x * 3 + 2)] = pr[x];
+            }
+        } else {
+            const Pixel* src = image.Row(y);
+            for (int x = 0; x < width; ++x) {
+                row[static_cast<size_t>(x * 3 + 0)] = src[x].b;
+                row[static_cast<size_t>(x * 3 + 1)] = src[x].g;
+                row[static_cast<size_t>(x * 3 + 2)] = src[x].r;
+            }
         }
         out.write(reinterpret_cast<const char*>(row.data()), row_bytes);
         if (padding) out.write(reinterpret_cast<const char*>(pad), padding);
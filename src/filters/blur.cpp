@@ -1,63 +1,227 @@
 #include "filters/blur.h"
 
+#include "stencil.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <vector>
 
 class BlurFilter final : public Filter {
 public:
-    explicit BlurFilter(double sigma) : sigma_(sigma) {
-        if (sigma_ < 0.0) throw std::invalid_argument("sigma must be >= 0");
+    explicit BlurFilter(double sigma)
+        : kernel_(GaussianKernel1D(sigma)), radius_(static_cast<int>((kernel_.size() - 1) / 2)) {
+        if (sigma < 0.0) throw std::invalid_argument("sigma must be >= 0");
     }
 
+    int GetHalo() const override { return radius_; }
+
+    bool IsLocal() const override { return true; }
+
+    PixelLayout GetPreferredLayout() const override { return PixelLayout::Planar; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
+    int GetTemporaryImages() const override { return 2; }
+
     void Apply(Image& image) const override {
         const int w = image.GetWidth();
         const int h = image.GetHeight();
-        const std::vector<double> k = GaussianKernel1D(sigma_);
-        const int radius = static_cast<int>((k.size() - 1) / 2);
+        const std::vector<double>& k = kernel_;
+        const int radius = radius_;
+        RequireBorder(image, radius);
 
-        Image tmp(w, h);
+        const int rows = ChannelRowCount(image);
+        const size_t len = static_cast<size_t>(w) * static_cast<size_t>(SampleStep(image));
+        std::vector<double> acc(len * static_cast<size_t>(rows));
+        auto round = [](double rr, double gg, double bb) {
+            return Pixel{ClampU8(static_cast<int>(std::lround(rr))),
+                         ClampU8(static_cast<int>(std::lround(gg))),
+                         ClampU8(static_cast<int>(std::lround(bb)))};
+        };
+
+        Image tmp = AcquireImage(w, h, radius, image.GetBorderMode(), image.GetLayout());
         for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                double rr = 0.0, gg = 0.0, bb = 0.0;
+            std::fill(acc.begin(), acc.end(), 0.0);
+            for (int c = 0; c < rows; ++c) {
                 for (int i = -radius; i <= radius; ++i) {
-                    const Pixel p = GetClamped(image, x + i, y);
-                    const double wgt = k[static_cast<size_t>(i + radius)];
-                    rr += wgt * p.r;
-                    gg += wgt * p.g;
-                    bb += wgt * p.b;
+                    AccumulateRow(acc.data() + static_cast<size_t>(c) * len, ChannelRow(image, c, y, i),
+                                  k[static_cast<size_t>(i + radius)], len);
                 }
-                tmp.SetPixel(x, y, Pixel{ClampU8(static_cast<int>(std::lround(rr))),
-                                         ClampU8(static_cast<int>(std::lround(gg))),
-                                         ClampU8(static_cast<int>(std::lround(bb)))});
             }
+            StoreRow(tmp, y, acc.data(), len, round);
         }
+        tmp.PrepareBorder(radius);
 
-        Image out(w, h);
+        Image out = AcquireImage(w, h, image.GetBorder(), image.GetBorderMode(), image.GetLayout());
         for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                double rr = 0.0, gg = 0.0, bb = 0.0;
+            std::fill(acc.begin(), acc.end(), 0.0);
+            for (int c = 0; c < rows; ++c) {
                 for (int i = -radius; i <= radius; ++i) {
-                    const Pixel p = GetClamped(tmp, x, y + i);
-                    const double wgt = k[static_cast<size_t>(i + radius)];
-                    rr += wgt * p.r;
-                    gg += wgt * p.g;
-                    bb += wgt * p.b;
+                    AccumulateRow(acc.data() + static_cast<size_t>(c) * len, ChannelRow(tmp, c, y + i, 0),
+                                  k[static_cast<size_t>(i + radius)], len);
+                }
+            }
+            StoreRow(out, y, acc.data(), len, round);
+        }
+
+        RecycleImage(std::move(tmp));
+        ReplaceImage(image, std::move(out));
+    }
+
+private:
+    std::vector<double> kernel_;
+    int radius_;
+};
+
+// y[n] = b * x[n] + a1 * y[n - 1] + a2 * y[n - 2] + a3 * y[n - 3], with the
+// pole placement of Young and van Vliet (1995) scaled by q.
+struct RecursiveCoefficients {
+    double b;
+    double a1;
+    double a2;
+    double a3;
+};
+
+// Against the FIR path on uniform noise the largest per-channel error is 34
+// at sigma 0.7, 14 at 1.5 and 5 from 3 up, so narrower blurs always stay FIR.
+// The floor does not help at full-contrast step edges: the third-order
+// response is not quite Gaussian in shape, which costs 9 to 14 levels at
+// every sigma from 3 to 12 and up to 17 on the worst input.
+static constexpr double kMinRecursiveSigma = 3.0;
+
+static RecursiveCoefficients YoungVanVliet(double q) {
+    const double q2 = q * q;
+    const double q3 = q2 * q;
+    const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    const double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+    const double b2 = -(1.4281 * q2 + 1.26661 * q3);
+    const double b3 = 0.422205 * q3;
+    return {1.0 - (b1 + b2 + b3) / b0, b1 / b0, b2 / b0, b3 / b0};
+}
+
+// Variance of the causal pass followed by the anti-causal one, from the
+// moments of the impulse response's generating function at z = 1.
+static double ResponseVariance(const RecursiveCoefficients& k) {
+    const double m1 = k.a1 + 2.0 * k.a2 + 3.0 * k.a3;
+    const double m2 = 2.0 * k.a2 + 6.0 * k.a3;
+    return 2.0 * (m2 / k.b + (m1 * m1) / (k.b * k.b) + m1 / k.b);
+}
+
+// The paper's closed-form q(sigma) overshoots sigma by about 10%, so q is
+// solved for instead: the response variance grows monotonically with q.
+static RecursiveCoefficients RecursiveGaussian(double sigma) {
+    double lo = 1e-3;
+    double hi = 2.0 * sigma + 2.0;
+    for (int i = 0; i < 60; ++i) {
+        const double mid = 0.5 * (lo + hi);
+        if (ResponseVariance(YoungVanVliet(mid)) < sigma * sigma) lo = mid;
+        else hi = mid;
+    }
+    return YoungVanVliet(0.5 * (lo + hi));
+}
+
+// Filters `lanes` independent signals of n samples each, sample i of lane j
+// at buf[(3 + i) * lanes + j], causally and then anti-causally. The three
+// rows on either side are scratch holding the edge value as initial state.
+static void RecursiveSweep(double* buf, size_t n, size_t lanes, const RecursiveCoefficients& k) {
+    const double* first = buf + 3 * lanes;
+    for (size_t r = 0; r < 3; ++r) std::copy(first, first + lanes, buf + r * lanes);
+    for (size_t r = 3; r < n + 3; ++r) {
+        double* y = buf + r * lanes;
+        const double* y1 = y - lanes;
+        const double* y2 = y1 - lanes;
+        const double* y3 = y2 - lanes;
+        for (size_t j = 0; j < lanes; ++j) y[j] = k.b * y[j] + k.a1 * y1[j] + k.a2 * y2[j] + k.a3 * y3[j];
+    }
+
+    const double* last = buf + (n + 2) * lanes;
+    for (size_t r = n + 3; r < n + 6; ++r) std::copy(last, last + lanes, buf + r * lanes);
+    for (size_t r = n + 3; r-- > 3;) {
+        double* y = buf + r * lanes;
+        const double* y1 = y + lanes;
+        const double* y2 = y1 + lanes;
+        const double* y3 = y2 + lanes;
+        for (size_t j = 0; j < lanes; ++j) y[j] = k.b * y[j] + k.a1 * y1[j] + k.a2 * y2[j] + k.a3 * y3[j];
+    }
+}
+
+static uint8_t RoundSample(double v) {
+    return ClampU8(static_cast<int>(std::lround(v)));
+}
+
+// Each pass starts its recursion `radius` samples out in the apron, so border
+// modes are honoured, but an output still depends on every input to its left
+// and above. The filter is therefore not local and is never tiled.
+class RecursiveBlurFilter final : public Filter {
+public:
+    explicit RecursiveBlurFilter(double sigma)
+        : radius_(static_cast<int>(std::ceil(3.0 * sigma))), k_(RecursiveGaussian(sigma)) {}
+
+    int GetHalo() const override { return radius_; }
+    PixelLayout GetPreferredLayout() const override { return PixelLayout::Planar; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
+    int GetTemporaryImages() const override { return 2; }
+
+    void Apply(Image& image) const override {
+        const int w = image.GetWidth();
+        const int h = image.GetHeight();
+        RequireBorder(image, radius_);
+        if (w == 0 || h == 0) return;
+
+        const int rows = ChannelRowCount(image);
+        const size_t step = static_cast<size_t>(SampleStep(image));
+        const size_t len = static_cast<size_t>(w) * step;
+        const size_t pad = static_cast<size_t>(radius_) * step;
+
+        // Horizontal: an interleaved channel row is `step` lanes of samples.
+        std::vector<double> buf((static_cast<size_t>(w + 2 * radius_) + 6) * step);
+        Image tmp = AcquireImage(w, h, radius_, image.GetBorderMode(), image.GetLayout());
+        for (int y = 0; y < h; ++y) {
+            for (int c = 0; c < rows; ++c) {
+                const uint8_t* src = ChannelRow(image, c, y, -radius_);
+                std::copy(src, src + len + 2 * pad, buf.begin() + static_cast<std::ptrdiff_t>(3 * step));
+                RecursiveSweep(buf.data(), static_cast<size_t>(w + 2 * radius_), step, k_);
+                const double* filtered = buf.data() + 3 * step + pad;
+                uint8_t* dst = ChannelRow(tmp, c, y, 0);
+                for (size_t i = 0; i < len; ++i) dst[i] = RoundSample(filtered[i]);
+            }
+        }
+        tmp.PrepareBorder(radius_);
+
+        // Vertical: strips of columns, each sample a lane.
+        const size_t n = static_cast<size_t>(h + 2 * radius_);
+        std::vector<double> strip((n + 6) * kStripSamples);
+        Image out = AcquireImage(w, h, image.GetBorder(), image.GetBorderMode(), image.GetLayout());
+        for (int c = 0; c < rows; ++c) {
+            for (size_t s0 = 0; s0 < len; s0 += kStripSamples) {
+                const size_t lanes = std::min(kStripSamples, len - s0);
+                for (size_t r = 0; r < n; ++r) {
+                    const uint8_t* src = ChannelRow(tmp, c, static_cast<int>(r) - radius_, 0) + s0;
+                    std::copy(src, src + lanes, strip.begin() + static_cast<std::ptrdiff_t>((r + 3) * lanes));
+                }
+                RecursiveSweep(strip.data(), n, lanes, k_);
+                for (int y = 0; y < h; ++y) {
+                    const double* filtered = strip.data() + (static_cast<size_t>(y + radius_) + 3) * lanes;
+                    uint8_t* dst = ChannelRow(out, c, y, 0) + s0;
+                    for (size_t j = 0; j < lanes; ++j) dst[j] = RoundSample(filtered[j]);
                 }
-                out.SetPixel(x, y, Pixel{ClampU8(static_cast<int>(std::lround(rr))),
-                                         ClampU8(static_cast<int>(std::lround(gg))),
-                                         ClampU8(static_cast<int>(std::lround(bb)))});
             }
         }
 
-        image = std::move(out);
+        RecycleImage(std::move(tmp));
+        ReplaceImage(image, std::move(out));
     }
 
 private:
-    double sigma_;
+    static constexpr size_t kStripSamples = 64;
+
+    int radius_;
+    RecursiveCoefficients k_;
 };
 
-std::unique_ptr<Filter> MakeBlur(double sigma) {
+std::unique_ptr<Filter> MakeBlur(double sigma, BlurVariant variant) {
+    if (variant == BlurVariant::Recursive && sigma >= kMinRecursiveSigma) {
+        return std::make_unique<RecursiveBlurFilter>(sigma);
+    }
     return std::make_unique<BlurFilter>(sigma);
 }
\ No newline at end of file
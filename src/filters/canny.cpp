@@ -0,0 +1,347 @@
+#include "filters/canny.h"
+
+#include "parallel.h"
+#include "stencil.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Rows per task for the row-wise stages, and the tile side for the
+// neighbourhood stages.
+static constexpr int kRowBlock = 16;
+static constexpr int kTileSize = 256;
+
+static constexpr float kTan22 = 0.41421356f;
+
+// Single-channel float samples with an apron of `pad` on every side.
+class FloatPlane {
+public:
+    FloatPlane() = default;
+    FloatPlane(int width, int height, int pad)
+        : pad_(pad),
+          stride_(static_cast<size_t>(width) + 2 * static_cast<size_t>(pad)),
+          buf_(sizeof(float) * stride_ * (static_cast<size_t>(height) + 2 * static_cast<size_t>(pad))) {}
+
+    float* Row(int y) {
+        return reinterpret_cast<float*>(buf_.Data()) + static_cast<size_t>(y + pad_) * stride_ + pad_;
+    }
+
+private:
+    int pad_ = 0;
+    size_t stride_ = 0;
+    AlignedBuffer buf_;
+};
+
+// AlignedBuffer storage holding `count` atomics, so the union-find arrays
+// count towards the memory budget like everything else.
+template <typename T>
+class AtomicArray {
+public:
+    explicit AtomicArray(size_t count) : buf_(sizeof(std::atomic<T>) * count) {
+        static_assert(std::is_trivially_destructible<std::atomic<T>>::value, "atomics are never destroyed");
+        for (size_t i = 0; i < count; ++i) new (buf_.Data() + i * sizeof(std::atomic<T>)) std::atomic<T>(T{});
+    }
+
+    std::atomic<T>& operator[](size_t i) {
+        return *std::launder(reinterpret_cast<std::atomic<T>*>(buf_.Data() + i * sizeof(std::atomic<T>)));
+    }
+
+private:
+    AlignedBuffer buf_;
+};
+
+// Lock-free union-find: roots are linked by index, larger under smaller, so
+// concurrent unions cannot form a cycle; Find halves paths as it goes.
+static int32_t Find(AtomicArray<int32_t>& parent, int32_t p) {
+    for (;;) {
+        int32_t q = parent[static_cast<size_t>(p)].load(std::memory_order_relaxed);
+        if (q == p) return p;
+        const int32_t g = parent[static_cast<size_t>(q)].load(std::memory_order_relaxed);
+        if (g != q) parent[static_cast<size_t>(p)].compare_exchange_weak(q, g, std::memory_order_relaxed);
+        p = g;
+    }
+}
+
+static void Union(AtomicArray<int32_t>& parent, int32_t a, int32_t b) {
+    for (;;) {
+        a = Find(parent, a);
+        b = Find(parent, b);
+        if (a == b) return;
+        if (a > b) std::swap(a, b);
+        int32_t expected = b;
+        if (parent[static_cast<size_t>(b)].compare_exchange_strong(expected, a)) return;
+    }
+}
+
+static void LumaRow(const Image& image, int y, int x0, int count, float* dst) {
+    if (image.GetLayout() == PixelLayout::Packed) {
+        const Pixel* src = image.Row(y) + x0;
+        for (int i = 0; i < count; ++i) {
+            dst[i] = (0.299f * src[i].r + 0.587f * src[i].g + 0.114f * src[i].b) * (1.0f / 255.0f);
+        }
+        return;
+    }
+    const uint8_t* r = image.PlaneRow(0, y) + x0;
+    const uint8_t* g = image.PlaneRow(1, y) + x0;
+    const uint8_t* b = image.PlaneRow(2, y) + x0;
+    for (int i = 0; i < count; ++i) dst[i] = (0.299f * r[i] + 0.587f * g[i] + 0.114f * b[i]) * (1.0f / 255.0f);
+}
+
+class CannyFilter final : public Filter {
+public:
+    CannyFilter(double sigma, double lo, double hi)
+        : kernel_(GaussianKernel1D(sigma)), lo_(static_cast<float>(lo)), hi_(static_cast<float>(hi)) {
+        if (sigma < 0.0) throw std::invalid_argument("sigma must be >= 0");
+        if (lo < 0.0 || lo > hi) throw std::invalid_argument("canny thresholds must satisfy 0 <= lo <= hi");
+    }
+
+    // Blur radius plus one for the Sobel taps.
+    int GetHalo() const override { return static_cast<int>(kernel_.size() / 2) + 1; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
+
+    // Stages free what they no longer need, so at most two float planes and
+    // two byte planes (or the union-find arrays and the output) are alive:
+    // about 9 bytes per pixel, three images' worth.
+    int GetTemporaryImages() const override { return 3; }
+
+    void Apply(Image& image) const override { ApplyParallel(image, 1); }
+
+    void ApplyParallel(Image& image, int threads) const override {
+        const int w = image.GetWidth();
+        const int h = image.GetHeight();
+        const int halo = GetHalo();
+        RequireBorder(image, halo);
+        if (w == 0 || h == 0) return;
+        if (static_cast<int64_t>(w) * h > std::numeric_limits<int32_t>::max()) {
+            throw std::runtime_error("image too large for canny");
+        }
+
+        const size_t count = static_cast<size_t>(w) * static_cast<size_t>(h);
+        FloatPlane mag;
+        AlignedBuffer dirs;
+        {
+            FloatPlane blurred = Blur(image, threads);
+            mag = FloatPlane(w, h, 1);
+            dirs = AlignedBuffer(count);
+            Sobel(blurred, mag, dirs.Data(), w, h, threads);
+        }
+
+        AlignedBuffer cls(count);
+        Suppress(mag, dirs.Data(), cls.Data(), w, h, threads);
+        mag = FloatPlane();
+        dirs = AlignedBuffer();
+
+        Image out = AcquireImage(w, h, image.GetBorder(), image.GetBorderMode(), image.GetLayout());
+        Hysteresis(cls.Data(), out, threads);
+        ReplaceImage(image, std::move(out));
+    }
+
+private:
+    // Separable Gaussian of the luma over [-1, w + 1) x [-1, h + 1), the
+    // extent the Sobel taps read.
+    FloatPlane Blur(const Image& image, int threads) const {
+        const int w = image.GetWidth();
+        const int h = image.GetHeight();
+        const int halo = GetHalo();
+        const int r = halo - 1;
+        const int n = static_cast<int>(kernel_.size());
+        const std::vector<float> k(kernel_.begin(), kernel_.end());
+        const size_t blocks = static_cast<size_t>((h + 2 * halo + kRowBlock - 1) / kRowBlock);
+
+        FloatPlane horiz(w, h, halo);
+        {
+            FloatPlane luma(w, h, halo);
+            ParallelFor(blocks, threads, [&](size_t b) {
+                const int y0 = -halo + static_cast<int>(b) * kRowBlock;
+                const int y1 = std::min(y0 + kRowBlock, h + halo);
+                for (int y = y0; y < y1; ++y) {
+                    const float* src = luma.Row(y);
+                    LumaRow(image, y, -halo, w + 2 * halo, luma.Row(y) - halo);
+                    float* dst = horiz.Row(y) - 1;
+                    for (int i = 0; i < n; ++i) {
+                        const float* s = src - 1 + (i - r);
+                        const float wgt = k[static_cast<size_t>(i)];
+                        for (int x = 0; x < w + 2; ++x) dst[x] += wgt * s[x];
+                    }
+                }
+            });
+        }
+
+        FloatPlane blurred(w, h, 1);
+        const size_t out_blocks = static_cast<size_t>((h + 2 + kRowBlock - 1) / kRowBlock);
+        ParallelFor(out_blocks, threads, [&](size_t b) {
+            const int y0 = -1 + static_cast<int>(b) * kRowBlock;
+            const int y1 = std::min(y0 + kRowBlock, h + 1);
+            for (int y = y0; y < y1; ++y) {
+                float* dst = blurred.Row(y) - 1;
+                for (int i = 0; i < n; ++i) {
+                    const float* s = horiz.Row(y + i - r) - 1;
+                    const float wgt = k[static_cast<size_t>(i)];
+                    for (int x = 0; x < w + 2; ++x) dst[x] += wgt * s[x];
+                }
+            }
+        });
+        return blurred;
+    }
+
+    // Gradient magnitude, scaled so a black-to-white step scores 1, and its
+    // direction quantised to 0 (horizontal), 1 (down-right), 2 (vertical) or
+    // 3 (up-right). Each row goes through the two branch-free loops below,
+    // which GCC and Clang vectorise (std::sqrt needs -fno-math-errno).
+    static void Sobel(FloatPlane& src, FloatPlane& mag, uint8_t* dirs, int w, int h, int threads) {
+        const size_t blocks = static_cast<size_t>((h + kRowBlock - 1) / kRowBlock);
+        ParallelFor(blocks, threads, [&](size_t b) {
+            const int y0 = static_cast<int>(b) * kRowBlock;
+            const int y1 = std::min(y0 + kRowBlock, h);
+            std::vector<float> gx(static_cast<size_t>(w));
+            std::vector<float> gy(static_cast<size_t>(w));
+            for (int y = y0; y < y1; ++y) {
+                SobelRow(src.Row(y - 1), src.Row(y), src.Row(y + 1), gx.data(), gy.data(), w);
+                GradientRow(gx.data(), gy.data(), mag.Row(y), dirs + static_cast<size_t>(y) * static_cast<size_t>(w), w);
+            }
+        });
+    }
+
+    // Only the taps: with two output rows the run-time alias checks stay
+    // within what the vectoriser will emit.
+    static void SobelRow(const float* a, const float* c, const float* e, float* gx, float* gy, int w) {
+        for (int x = 0; x < w; ++x) {
+            gx[x] = (a[x + 1] + 2.0f * c[x + 1] + e[x + 1]) - (a[x - 1] + 2.0f * c[x - 1] + e[x - 1]);
+            gy[x] = (e[x - 1] + 2.0f * e[x] + e[x + 1]) - (a[x - 1] + 2.0f * a[x] + a[x + 1]);
+        }
+    }
+
+    // The sector comes from compare masks rather than branches. Horizontal
+    // wins over vertical, which only ties it at a zero gradient; the
+    // diagonal is 1 where gx and gy agree in sign, else 3.
+    static void GradientRow(const float* gx, const float* gy, float* m, uint8_t* d, int w) {
+        for (int x = 0; x < w; ++x) {
+            m[x] = 0.25f * std::sqrt(gx[x] * gx[x] + gy[x] * gy[x]);
+            const float ax = std::fabs(gx[x]);
+            const float ay = std::fabs(gy[x]);
+            const int horizontal = ay <= kTan22 * ax;
+            const int vertical = ax <= kTan22 * ay;
+            const int diagonal = 1 + 2 * ((gx[x] > 0.0f) ^ (gy[x] > 0.0f));
+            d[x] = static_cast<uint8_t>((1 - horizontal) * (2 * vertical + (1 - vertical) * diagonal));
+        }
+    }
+
+    // Non-maximum suppression tile by tile: a pixel survives if it beats its
+    // neighbours across the edge (ties go to the first), then is classified
+    // as 2 (strong), 1 (weak) or 0 against the thresholds. The magnitude
+    // apron is zero, so image edges need no special case.
+    void Suppress(FloatPlane& mag, const uint8_t* dirs, uint8_t* cls, int w, int h, int threads) const {
+        const int tiles_x = (w + kTileSize - 1) / kTileSize;
+        const int tiles_y = (h + kTileSize - 1) / kTileSize;
+        ParallelFor(static_cast<size_t>(tiles_x) * static_cast<size_t>(tiles_y), threads, [&](size_t t) {
+            const int x0 = static_cast<int>(t % static_cast<size_t>(tiles_x)) * kTileSize;
+            const int y0 = static_cast<int>(t / static_cast<size_t>(tiles_x)) * kTileSize;
+            const int x1 = std::min(x0 + kTileSize, w);
+            const int y1 = std::min(y0 + kTileSize, h);
+            for (int y = y0; y < y1; ++y) {
+                const float* up = mag.Row(y - 1);
+                const float* row = mag.Row(y);
+                const float* down = mag.Row(y + 1);
+                const size_t base = static_cast<size_t>(y) * static_cast<size_t>(w);
+                for (int x = x0; x < x1; ++x) {
+                    const float m = row[x];
+                    float before = 0.0f;
+                    float after = 0.0f;
+                    switch (dirs[base + static_cast<size_t>(x)]) {
+                    case 0: before = row[x - 1]; after = row[x + 1]; break;
+                    case 1: before = up[x - 1]; after = down[x + 1]; break;
+                    case 2: before = up[x]; after = down[x]; break;
+                    default: before = up[x + 1]; after = down[x - 1]; break;
+                    }
+                    const bool peak = m > before && m >= after;
+                    cls[base + static_cast<size_t>(x)] = !peak || m < lo_ ? 0 : (m >= hi_ ? 2 : 1);
+                }
+            }
+        });
+    }
+
+    // Hysteresis as connected components: every candidate pixel is joined to
+    // its 8-connected candidate neighbours above and to the left, all tiles
+    // at once on the lock-free forest. A component is kept if any of its
+    // pixels is strong.
+    static void Hysteresis(const uint8_t* cls, Image& out, int threads) {
+        const int w = out.GetWidth();
+        const int h = out.GetHeight();
+        const size_t count = static_cast<size_t>(w) * static_cast<size_t>(h);
+        AtomicArray<int32_t> parent(count);
+        AtomicArray<uint8_t> strong(count);
+
+        const int tiles_x = (w + kTileSize - 1) / kTileSize;
+        const int tiles_y = (h + kTileSize - 1) / kTileSize;
+        const size_t tiles = static_cast<size_t>(tiles_x) * static_cast<size_t>(tiles_y);
+        auto for_each_tile = [&](auto&& visit) {
+            ParallelFor(tiles, threads, [&](size_t t) {
+                const int x0 = static_cast<int>(t % static_cast<size_t>(tiles_x)) * kTileSize;
+                const int y0 = static_cast<int>(t / static_cast<size_t>(tiles_x)) * kTileSize;
+                const int x1 = std::min(x0 + kTileSize, w);
+                const int y1 = std::min(y0 + kTileSize, h);
+                for (int y = y0; y < y1; ++y) {
+                    for (int x = x0; x < x1; ++x) visit(x, y, static_cast<int32_t>(y * w + x));
+                }
+            });
+        };
+
+        for_each_tile([&](int, int, int32_t p) { parent[static_cast<size_t>(p)].store(p, std::memory_order_relaxed); });
+
+        for_each_tile([&](int x, int y, int32_t p) {
+            if (!cls[static_cast<size_t>(p)]) return;
+            auto join = [&](int nx, int ny) {
+                if (nx < 0 || nx >= w || ny < 0) return;
+                const int32_t q = ny * w + nx;
+                if (cls[static_cast<size_t>(q)]) Union(parent, p, q);
+            };
+            join(x - 1, y);
+            join(x - 1, y - 1);
+            join(x, y - 1);
+            join(x + 1, y - 1);
+        });
+
+        for_each_tile([&](int, int, int32_t p) {
+            if (cls[static_cast<size_t>(p)] == 2) {
+                strong[static_cast<size_t>(Find(parent, p))].store(1, std::memory_order_relaxed);
+            }
+        });
+
+        const size_t blocks = static_cast<size_t>((h + kRowBlock - 1) / kRowBlock);
+        ParallelFor(blocks, threads, [&](size_t b) {
+            const int y0 = static_cast<int>(b) * kRowBlock;
+            const int y1 = std::min(y0 + kRowBlock, h);
+            std::vector<uint8_t> row(static_cast<size_t>(w));
+            for (int y = y0; y < y1; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    const int32_t p = y * w + x;
+                    const bool edge = cls[static_cast<size_t>(p)] &&
+                                      strong[static_cast<size_t>(Find(parent, p))].load(std::memory_order_relaxed);
+                    row[static_cast<size_t>(x)] = edge ? 255 : 0;
+                }
+                if (out.GetLayout() == PixelLayout::Planar) {
+                    for (int c = 0; c < 3; ++c) std::copy(row.begin(), row.end(), out.PlaneRow(c, y));
+                } else {
+                    Pixel* dst = out.Row(y);
+                    for (int x = 0; x < w; ++x) dst[x] = Pixel{row[static_cast<size_t>(x)], row[static_cast<size_t>(x)], row[static_cast<size_t>(x)]};
+                }
+            }
+        });
+    }
+
+    std::vector<double> kernel_;
+    float lo_;
+    float hi_;
+};
+
+std::unique_ptr<Filter> MakeCanny(double sigma, double lo, double hi) {
+    return std::make_unique<CannyFilter>(sigma, lo, hi);
+}
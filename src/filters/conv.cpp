@@ -0,0 +1,96 @@
+#include "filters/conv.h"
+
+#include "stencil.h"
+#include "utils.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+static Pixel RoundPixel(double rr, double gg, double bb) {
+    return Pixel{ClampU8(static_cast<int>(std::lround(rr))),
+                 ClampU8(static_cast<int>(std::lround(gg))),
+                 ClampU8(static_cast<int>(std::lround(bb)))};
+}
+
+// Splits a rank-1 kernel into column and row factors. Returns false when the
+// kernel is not separable.
+static bool Factorize(int n, const std::vector<double>& taps, std::vector<double>& col, std::vector<double>& row) {
+    size_t pivot = 0;
+    double max_abs = 0.0;
+    for (size_t i = 0; i < taps.size(); ++i) {
+        if (std::fabs(taps[i]) > max_abs) {
+            max_abs = std::fabs(taps[i]);
+            pivot = i;
+        }
+    }
+    if (max_abs == 0.0) return false;
+
+    const int pi = static_cast<int>(pivot) / n;
+    const int pj = static_cast<int>(pivot) % n;
+    const double p = taps[pivot];
+
+    col.assign(static_cast<size_t>(n), 0.0);
+    row.assign(static_cast<size_t>(n), 0.0);
+    for (int i = 0; i < n; ++i) col[static_cast<size_t>(i)] = taps[static_cast<size_t>(i * n + pj)] / p;
+    for (int j = 0; j < n; ++j) row[static_cast<size_t>(j)] = taps[static_cast<size_t>(pi * n + j)];
+
+    const double eps = 1e-9 * max_abs;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            const double v = col[static_cast<size_t>(i)] * row[static_cast<size_t>(j)];
+            if (std::fabs(v - taps[static_cast<size_t>(i * n + j)]) > eps) return false;
+        }
+    }
+    return true;
+}
+
+template <int N>
+static FixedKernel<double, N> ToFixed(const std::vector<double>& taps) {
+    FixedKernel<double, N> k;
+    for (int i = 0; i < N * N; ++i) k.taps[i] = taps[static_cast<size_t>(i)];
+    return k;
+}
+
+class ConvolutionFilter final : public Filter {
+public:
+    ConvolutionFilter(int size, std::vector<double> taps) : n_(size), taps_(std::move(taps)) {
+        if (n_ <= 0 || n_ % 2 == 0) throw std::invalid_argument("conv size must be odd and > 0");
+        if (taps_.size() != static_cast<size_t>(n_) * static_cast<size_t>(n_)) {
+            throw std::invalid_argument("conv expects size*size coefficients");
+        }
+        separable_ = n_ > 3 && Factorize(n_, taps_, col_, row_);
+    }
+
+    int GetHalo() const override { return n_ / 2; }
+    bool IsLocal() const override { return true; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
+
+    void Apply(Image& image) const override {
+        if (separable_) {
+            ReplaceImage(image, ApplySeparableStencil(image, row_, col_, RoundPixel));
+        } else if (n_ == 1) {
+            ReplaceImage(image, ApplyStencil(image, ToFixed<1>(taps_), RoundPixel));
+        } else if (n_ == 3) {
+            ReplaceImage(image, ApplyStencil(image, ToFixed<3>(taps_), RoundPixel));
+        } else if (n_ == 5) {
+            ReplaceImage(image, ApplyStencil(image, ToFixed<5>(taps_), RoundPixel));
+        } else {
+            DynamicKernel<double> k;
+            k.size = n_;
+            k.taps = taps_;
+            ReplaceImage(image, ApplyStencil(image, k, RoundPixel));
+        }
+    }
+
+private:
+    int n_;
+    std::vector<double> taps_;
+    bool separable_ = false;
+    std::vector<double> col_;
+    std::vector<double> row_;
+};
+
+std::unique_ptr<Filter> MakeConvolution(int size, std::vector<double> taps) {
+    return std::make_unique<ConvolutionFilter>(size, std::move(taps));
+}
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "filters/crop.h"
 
+#include "image_pool.h"
+
 #include <stdexcept>
 
 class CropFilter final : public Filter {
@@ -8,19 +10,21 @@ public:
         if (new_w_ <= 0 || new_h_ <= 0) throw std::invalid_argument("invalid crop size");
     }
 
+    bool SupportsLayout(PixelLayout) const override { return true; }
+
     void Apply(Image& image) const override {
         const int w = image.GetWidth();
         const int h = image.GetHeight();
         const int cw = (new_w_ < w) ? new_w_ : w;
         const int ch = (new_h_ < h) ? new_h_ : h;
 
-        Image out(cw, ch);
+        Image out = AcquireImage(cw, ch, image.GetBorder(), image.GetBorderMode(), image.GetLayout());
         for (int y = 0; y < ch; ++y) {
             for (int x = 0; x < cw; ++x) {
                 out.SetPixel(x, y, image.GetPixel(x, y));
             }
         }
-        image = std::move(out);
+        ReplaceImage(image, std::move(out));
     }
 
 private:
@@ -1,9 +1,18 @@
 #include "filters/edge.h"
 
+#include "stencil.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <cmath>
 #include <stdexcept>
+#include <vector>
+
+static constexpr FixedKernel<int, 3> kLaplacianKernel{{
+     0, -1,  0,
+    -1,  4, -1,
+     0, -1,  0,
+}};
 
 class EdgeFilter final : public Filter {
 public:
@@ -11,38 +20,48 @@ public:
         if (t_ < 0.0 || t_ > 1.0) throw std::invalid_argument("edge threshold must be in [0..1]");
     }
 
+    int GetHalo() const override { return kLaplacianKernel.Size() / 2; }
+    bool IsLocal() const override { return true; }
+    // The output plus a one-byte luma plane.
+    int GetTemporaryImages() const override { return 2; }
+
     void Apply(Image& image) const override {
         const int w = image.GetWidth();
         const int h = image.GetHeight();
+        const int r = GetHalo();
+        RequireBorder(image, r);
 
-        Image gray(w, h);
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                const Pixel p = image.GetPixel(x, y);
-                const int g = static_cast<int>(std::lround(0.299 * p.r + 0.587 * p.g + 0.114 * p.b));
-                const uint8_t gg = ClampU8(g);
-                gray.SetPixel(x, y, Pixel{gg, gg, gg});
+        // One byte of luma per pixel, apron included: the border mode maps
+        // pixels to pixels, so the luma of the prepared apron is the apron of
+        // the luma and the Laplacian runs on a single channel.
+        const size_t stride = static_cast<size_t>(w + 2 * r);
+        AlignedBuffer luma(stride * static_cast<size_t>(h + 2 * r));
+        auto luma_row = [&](int y) { return luma.Data() + static_cast<size_t>(y + r) * stride + r; };
+        for (int y = -r; y < h + r; ++y) {
+            const Pixel* src = image.Row(y);
+            uint8_t* dst = luma_row(y);
+            for (int x = -r; x < w + r; ++x) {
+                const Pixel p = src[x];
+                dst[x] = ClampU8(static_cast<int>(std::lround(0.299 * p.r + 0.587 * p.g + 0.114 * p.b)));
             }
         }
 
-        Image out(w, h);
-
+        Image out = AcquireImage(w, h, image.GetBorder(), image.GetBorderMode(), PixelLayout::Packed);
+        std::vector<int> acc(static_cast<size_t>(w));
         for (int y = 0; y < h; ++y) {
+            std::fill(acc.begin(), acc.end(), 0);
+            stencil_detail::ForEachTap(kLaplacianKernel, [&](int dy, int dx, int wgt) {
+                if (wgt == 0) return;
+                AccumulateRow(acc.data(), luma_row(y + dy) + dx, wgt, acc.size());
+            });
+            Pixel* dst = out.Row(y);
             for (int x = 0; x < w; ++x) {
-                const Pixel c = GetClamped(gray, x, y);
-                const Pixel l = GetClamped(gray, x - 1, y);
-                const Pixel r = GetClamped(gray, x + 1, y);
-                const Pixel u = GetClamped(gray, x, y - 1);
-                const Pixel d = GetClamped(gray, x, y + 1);
-
-                const int v = 4 * c.r - l.r - r.r - u.r - d.r;
-                const double v01 = static_cast<double>(ClampInt(v, 0, 255)) / 255.0;
-                const uint8_t outv = (v01 > t_) ? 255 : 0;
-                out.SetPixel(x, y, Pixel{outv, outv, outv});
+                const double v01 = static_cast<double>(ClampInt(acc[static_cast<size_t>(x)], 0, 255)) / 255.0;
+                const uint8_t v = (v01 > t_) ? 255 : 0;
+                dst[x] = Pixel{v, v, v};
             }
         }
-
-        image = std::move(out);
+        ReplaceImage(image, std::move(out));
     }
 
 private:
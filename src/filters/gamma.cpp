@@ -9,6 +9,10 @@ public:
         if (g_ <= 0.0) throw std::invalid_argument("gamma must be > 0");
     }
 
+    bool IsLocal() const override { return true; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
+    int GetTemporaryImages() const override { return 0; }
+
     void Apply(Image& image) const override {
         const int w = image.GetWidth();
         const int h = image.GetHeight();
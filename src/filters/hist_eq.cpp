@@ -4,10 +4,12 @@
 
 #include <array>
 #include <cmath>
-#include <vector>
 
 class HistEqFilter final : public Filter {
 public:
+    bool SupportsLayout(PixelLayout) const override { return true; }
+    int GetTemporaryImages() const override { return 0; }
+
     void Apply(Image& image) const override {
         const int w = image.GetWidth();
         const int h = image.GetHeight();
@@ -16,15 +18,11 @@ public:
         std::array<uint32_t, 256> hist{};
         hist.fill(0);
 
-        std::vector<uint8_t> lum;
-        lum.reserve(n);
-
         for (int y = 0; y < h; ++y) {
             for (int x = 0; x < w; ++x) {
                 const Pixel p = image.GetPixel(x, y);
                 const int g = static_cast<int>(std::lround(0.299 * p.r + 0.587 * p.g + 0.114 * p.b));
                 const uint8_t gg = ClampU8(g);
-                lum.push_back(gg);
                 hist[gg] += 1;
             }
         }
@@ -44,18 +42,15 @@ public:
             }
         }
 
-        Image out(w, h);
-        size_t idx = 0;
         for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x, ++idx) {
-                const uint8_t v = lum[idx];
+            for (int x = 0; x < w; ++x) {
+                const Pixel p = image.GetPixel(x, y);
+                const uint8_t v = ClampU8(static_cast<int>(std::lround(0.299 * p.r + 0.587 * p.g + 0.114 * p.b)));
                 const double mapped = (static_cast<double>(cdf[v] - cdf_min) / static_cast<double>(n - cdf_min)) * 255.0;
                 const uint8_t m = ClampU8(static_cast<int>(std::lround(mapped)));
-                out.SetPixel(x, y, Pixel{m, m, m});
+                image.SetPixel(x, y, Pixel{m, m, m});
             }
         }
-
-        image = std::move(out);
     }
 };
 
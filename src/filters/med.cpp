@@ -1,21 +1,125 @@
 #include "filters/med.h"
 
+#include "stencil.h"
 #include "utils.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <stdexcept>
 #include <vector>
 
+static void Exchange(uint8_t& a, uint8_t& b) {
+    const uint8_t lo = std::min(a, b);
+    b = std::max(a, b);
+    a = lo;
+}
+
+// Median of nine (Paeth / Devillard): p[4] ends up holding it.
+static uint8_t Median9(uint8_t* p) {
+    Exchange(p[1], p[2]); Exchange(p[4], p[5]); Exchange(p[7], p[8]);
+    Exchange(p[0], p[1]); Exchange(p[3], p[4]); Exchange(p[6], p[7]);
+    Exchange(p[1], p[2]); Exchange(p[4], p[5]); Exchange(p[7], p[8]);
+    Exchange(p[0], p[3]); Exchange(p[5], p[8]); Exchange(p[4], p[7]);
+    Exchange(p[3], p[6]); Exchange(p[1], p[4]); Exchange(p[2], p[5]);
+    Exchange(p[4], p[7]); Exchange(p[4], p[2]); Exchange(p[6], p[4]);
+    Exchange(p[4], p[2]);
+    return p[4];
+}
+
+// Both variants walk channel rows: the neighbours of sample i sit at
+// i + dx * step, whatever the layout.
+static void NetworkMedian(const Image& image, Image& out) {
+    const int h = image.GetHeight();
+    const std::ptrdiff_t step = SampleStep(image);
+    const std::ptrdiff_t len = static_cast<std::ptrdiff_t>(image.GetWidth()) * step;
+    for (int c = 0; c < ChannelRowCount(image); ++c) {
+        for (int y = 0; y < h; ++y) {
+            const uint8_t* above = ChannelRow(image, c, y - 1, 0);
+            const uint8_t* row = ChannelRow(image, c, y, 0);
+            const uint8_t* below = ChannelRow(image, c, y + 1, 0);
+            uint8_t* dst = ChannelRow(out, c, y, 0);
+            for (std::ptrdiff_t i = 0; i < len; ++i) {
+                uint8_t p[9] = {above[i - step], above[i], above[i + step],
+                                row[i - step],   row[i],   row[i + step],
+                                below[i - step], below[i], below[i + step]};
+                dst[i] = Median9(p);
+            }
+        }
+    }
+}
+
+// Huang's algorithm: the window slides right one sample at a time, trading
+// one column of 2r + 1 values, and the median is walked from its last value.
+static void HistogramMedian(const Image& image, Image& out, int r) {
+    const int w = image.GetWidth();
+    const int h = image.GetHeight();
+    const int step = SampleStep(image);
+    const int half = (2 * r + 1) * (2 * r + 1) / 2;
+    std::vector<const uint8_t*> rows(static_cast<size_t>(2 * r + 1));
+
+    for (int c = 0; c < ChannelRowCount(image); ++c) {
+        for (int y = 0; y < h; ++y) {
+            for (int dy = -r; dy <= r; ++dy) rows[static_cast<size_t>(dy + r)] = ChannelRow(image, c, y + dy, 0);
+            uint8_t* dst = ChannelRow(out, c, y, 0);
+
+            for (int lane = 0; lane < step; ++lane) {
+                int hist[256] = {};
+                for (const uint8_t* row : rows) {
+                    for (int dx = -r; dx <= r; ++dx) ++hist[row[(dx * step) + lane]];
+                }
+
+                int m = 0;
+                int below = 0;
+                for (int x = 0; x < w; ++x) {
+                    const int i = x * step + lane;
+                    if (x > 0) {
+                        for (const uint8_t* row : rows) {
+                            const uint8_t gone = row[i - (r + 1) * step];
+                            const uint8_t added = row[i + r * step];
+                            --hist[gone];
+                            ++hist[added];
+                            below += (added < m) - (gone < m);
+                        }
+                    }
+                    while (below > half) below -= hist[--m];
+                    while (below + hist[m] <= half) below += hist[m++];
+                    dst[i] = static_cast<uint8_t>(m);
+                }
+            }
+        }
+    }
+}
+
 class MedianFilter final : public Filter {
 public:
-    explicit MedianFilter(int radius) : r_(radius) {
+    MedianFilter(int radius, MedianVariant variant) : r_(radius), variant_(variant) {
         if (r_ < 0) throw std::invalid_argument("radius must be >= 0");
+        if (variant_ == MedianVariant::Network && r_ != 1) {
+            throw std::invalid_argument("sorting-network median needs radius 1");
+        }
     }
 
+    int GetHalo() const override { return r_; }
+    bool IsLocal() const override { return true; }
+    PixelLayout GetPreferredLayout() const override { return PixelLayout::Planar; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
+
     void Apply(Image& image) const override {
         const int w = image.GetWidth();
         const int h = image.GetHeight();
-        Image out(w, h);
+        RequireBorder(image, r_);
+        Image out = AcquireImage(w, h, image.GetBorder(), image.GetBorderMode(), image.GetLayout());
+
+        if (variant_ == MedianVariant::Network) {
+            NetworkMedian(image, out);
+            ReplaceImage(image, std::move(out));
+            return;
+        }
+        if (variant_ == MedianVariant::Histogram) {
+            HistogramMedian(image, out, r_);
+            ReplaceImage(image, std::move(out));
+            return;
+        }
 
         std::vector<int> vr;
         std::vector<int> vg;
@@ -25,33 +129,56 @@ public:
         vg.reserve(vr.capacity());
         vb.reserve(vr.capacity());
 
+        auto median = [](std::vector<int>& v) -> uint8_t {
+            const size_t mid = v.size() / 2;
+            std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(mid), v.end());
+            return ClampU8(v[mid]);
+        };
+
+        if (image.GetLayout() == PixelLayout::Planar) {
+            std::vector<const uint8_t*> rows(static_cast<size_t>(2 * r_ + 1));
+            for (int c = 0; c < 3; ++c) {
+                for (int y = 0; y < h; ++y) {
+                    for (int dy = -r_; dy <= r_; ++dy) rows[static_cast<size_t>(dy + r_)] = image.PlaneRow(c, y + dy);
+                    uint8_t* dst = out.PlaneRow(c, y);
+                    for (int x = 0; x < w; ++x) {
+                        vr.clear();
+                        for (const uint8_t* row : rows) {
+                            for (int dx = -r_; dx <= r_; ++dx) vr.push_back(row[x + dx]);
+                        }
+                        dst[x] = median(vr);
+                    }
+                }
+            }
+            ReplaceImage(image, std::move(out));
+            return;
+        }
+
         for (int y = 0; y < h; ++y) {
+            Pixel* dst = out.Row(y);
             for (int x = 0; x < w; ++x) {
                 vr.clear(); vg.clear(); vb.clear();
                 for (int dy = -r_; dy <= r_; ++dy) {
+                    const Pixel* row = image.Row(y + dy);
                     for (int dx = -r_; dx <= r_; ++dx) {
-                        const Pixel p = GetClamped(image, x + dx, y + dy);
+                        const Pixel p = row[x + dx];
                         vr.push_back(p.r);
                         vg.push_back(p.g);
                         vb.push_back(p.b);
                     }
                 }
-                auto median = [](std::vector<int>& v) -> uint8_t {
-                    const size_t mid = v.size() / 2;
-                    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(mid), v.end());
-                    return ClampU8(v[mid]);
-                };
-                out.SetPixel(x, y, Pixel{median(vr), median(vg), median(vb)});
+                dst[x] = Pixel{median(vr), median(vg), median(vb)};
             }
         }
 
-        image = std::move(out);
+        ReplaceImage(image, std::move(out));
     }
 
 private:
     int r_;
+    MedianVariant variant_;
 };
 
-std::unique_ptr<Filter> MakeMedian(int radius) {
-    return std::make_unique<MedianFilter>(radius);
+std::unique_ptr<Filter> MakeMedian(int radius, MedianVariant variant) {
+    return std::make_unique<MedianFilter>(radius, variant);
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 class NegativeFilter final : public Filter {
 public:
+    bool IsLocal() const override { return true; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
+    int GetTemporaryImages() const override { return 0; }
+
     void Apply(Image& image) const override {
         const int w = image.GetWidth();
         const int h = image.GetHeight();
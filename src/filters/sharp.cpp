@@ -1,31 +1,24 @@
 #include "filters/sharp.h"
 
+#include "stencil.h"
 #include "utils.h"
 
+static constexpr FixedKernel<int, 3> kSharpenKernel{{
+     0, -1,  0,
+    -1,  5, -1,
+     0, -1,  0,
+}};
+
 class SharpenFilter final : public Filter {
 public:
-    void Apply(Image& image) const override {
-        const int w = image.GetWidth();
-        const int h = image.GetHeight();
-        Image out(w, h);
-
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                const Pixel c = GetClamped(image, x, y);
-                const Pixel l = GetClamped(image, x - 1, y);
-                const Pixel r = GetClamped(image, x + 1, y);
-                const Pixel u = GetClamped(image, x, y - 1);
-                const Pixel d = GetClamped(image, x, y + 1);
+    int GetHalo() const override { return kSharpenKernel.Size() / 2; }
+    bool IsLocal() const override { return true; }
+    bool SupportsLayout(PixelLayout) const override { return true; }
 
-                const int rr = 5 * c.r - l.r - r.r - u.r - d.r;
-                const int gg = 5 * c.g - l.g - r.g - u.g - d.g;
-                const int bb = 5 * c.b - l.b - r.b - u.b - d.b;
-
-                out.SetPixel(x, y, Pixel{ClampU8(rr), ClampU8(gg), ClampU8(bb)});
-            }
-        }
-
-        image = std::move(out);
+    void Apply(Image& image) const override {
+        ReplaceImage(image, ApplyStencil(image, kSharpenKernel, [](int rr, int gg, int bb) {
+            return Pixel{ClampU8(rr), ClampU8(gg), ClampU8(bb)};
+        }));
     }
 };
 
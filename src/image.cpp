@@ -1,26 +1,223 @@
 #include "image.h"
 
+#include "utils.h"
+
+#include <algorithm>
 #include <stdexcept>
+#include <utility>
 
-Image::Image(int width, int height)
-    : width_(width)
-    , height_(height)
-    , data_(static_cast<size_t>(width) * static_cast<size_t>(height)) {
+static int MapBorderIndex(int i, int n, BorderMode mode) {
+    switch (mode) {
+    case BorderMode::Clamp:
+        return ClampInt(i, 0, n - 1);
+    case BorderMode::Wrap: {
+        const int m = i % n;
+        return m < 0 ? m + n : m;
+    }
+    case BorderMode::Mirror: {
+        if (n == 1) return 0;
+        const int period = 2 * (n - 1);
+        int m = i % period;
+        if (m < 0) m += period;
+        return m < n ? m : period - m;
+    }
+    }
+    return ClampInt(i, 0, n - 1);
+}
+
+template <typename T>
+static void FillRowApron(T* row, int width, int border, BorderMode mode) {
+    for (int x = -border; x < 0; ++x) row[x] = row[MapBorderIndex(x, width, mode)];
+    for (int x = width; x < width + border; ++x) row[x] = row[MapBorderIndex(x, width, mode)];
+}
+
+Image::Image(int width, int height, int border, BorderMode mode, PixelLayout layout) {
+    SetGeometry(width, height, border, mode, layout);
+    data_ = AlignedBuffer(BufferBytes());
+}
+
+void Image::SetGeometry(int width, int height, int border, BorderMode mode, PixelLayout layout) {
     if (width < 0 || height < 0) {
         throw std::invalid_argument("negative image size");
     }
+    if (border < 0) {
+        throw std::invalid_argument("negative image border");
+    }
+
+    width_ = width;
+    height_ = height;
+    border_ = border;
+    mode_ = mode;
+    layout_ = layout;
+    plane_left_ = 0;
+    plane_stride_ = 0;
+    plane_size_ = 0;
+    if (layout_ == PixelLayout::Planar) {
+        plane_left_ = AlignUp(static_cast<size_t>(border), kBufferAlignment);
+        plane_stride_ = AlignUp(plane_left_ + static_cast<size_t>(width + border), kBufferAlignment);
+        plane_size_ = plane_stride_ * static_cast<size_t>(height + 2 * border);
+    }
+}
+
+size_t Image::BufferBytes() const {
+    if (layout_ == PixelLayout::Planar) return 3 * plane_size_;
+    return static_cast<size_t>(GetStride()) * static_cast<size_t>(height_ + 2 * border_) * sizeof(Pixel);
+}
+
+bool Image::Reshape(int width, int height, int border, BorderMode mode, PixelLayout layout) {
+    Image shaped;
+    shaped.SetGeometry(width, height, border, mode, layout);
+    if (shaped.BufferBytes() > data_.Size()) return false;
+    shaped.data_ = std::move(data_);
+    *this = std::move(shaped);
+    return true;
+}
+
+size_t Image::GetCapacity() const { return data_.Size(); }
+
+size_t Image::StorageBytes(int width, int height, int border, PixelLayout layout) {
+    Image shaped;
+    shaped.SetGeometry(width, height, border, BorderMode::Clamp, layout);
+    return shaped.BufferBytes();
+}
+
+size_t Image::EstimateBytes(int width, int height, int border, PixelLayout layout) {
+    return AllocatedBytes(StorageBytes(width, height, border, layout));
 }
 
 int Image::GetWidth() const { return width_; }
 int Image::GetHeight() const { return height_; }
+int Image::GetBorder() const { return border_; }
+int Image::GetStride() const { return width_ + 2 * border_; }
+
+BorderMode Image::GetBorderMode() const { return mode_; }
+void Image::SetBorderMode(BorderMode mode) { mode_ = mode; }
+
+PixelLayout Image::GetLayout() const { return layout_; }
+
+void Image::ConvertTo(PixelLayout layout) {
+    if (layout == layout_) return;
+    Image converted(width_, height_, border_, mode_, layout);
+    converted.CopyRect(*this, 0, 0, 0, 0, width_, height_);
+    *this = std::move(converted);
+}
+
+size_t Image::Index(int x, int y) const {
+    return static_cast<size_t>(y + border_) * static_cast<size_t>(GetStride()) + static_cast<size_t>(x + border_);
+}
+
+size_t Image::PlaneIndex(int c, int x, int y) const {
+    return static_cast<size_t>(c) * plane_size_ + static_cast<size_t>(y + border_) * plane_stride_ +
+           static_cast<size_t>(static_cast<std::ptrdiff_t>(plane_left_) + x);
+}
+
+void Image::CheckRange(int x, int y) const {
+    if (x < -border_ || x >= width_ + border_ || y < -border_ || y >= height_ + border_) {
+        throw std::out_of_range("pixel out of range");
+    }
+}
 
 Pixel Image::GetPixel(int x, int y) const {
-    return data_.at(static_cast<size_t>(y) * static_cast<size_t>(width_) + static_cast<size_t>(x));
+    CheckRange(x, y);
+    if (layout_ == PixelLayout::Packed) return reinterpret_cast<const Pixel*>(data_.Data())[Index(x, y)];
+    const uint8_t* p = data_.Data();
+    return Pixel{p[PlaneIndex(0, x, y)], p[PlaneIndex(1, x, y)], p[PlaneIndex(2, x, y)]};
 }
 
 void Image::SetPixel(int x, int y, Pixel p) {
-    data_.at(static_cast<size_t>(y) * static_cast<size_t>(width_) + static_cast<size_t>(x)) = p;
+    CheckRange(x, y);
+    if (layout_ == PixelLayout::Packed) {
+        reinterpret_cast<Pixel*>(data_.Data())[Index(x, y)] = p;
+        return;
+    }
+    uint8_t* d = data_.Data();
+    d[PlaneIndex(0, x, y)] = p.r;
+    d[PlaneIndex(1, x, y)] = p.g;
+    d[PlaneIndex(2, x, y)] = p.b;
+}
+
+Pixel* Image::Row(int y) {
+    if (layout_ != PixelLayout::Packed) throw std::logic_error("Row() needs a packed image");
+    return reinterpret_cast<Pixel*>(data_.Data()) + Index(0, y);
 }
 
-std::vector<Pixel>& Image::Data() { return data_; }
-const std::vector<Pixel>& Image::Data() const { return data_; }
\ No newline at end of file
+const Pixel* Image::Row(int y) const {
+    if (layout_ != PixelLayout::Packed) throw std::logic_error("Row() needs a packed image");
+    return reinterpret_cast<const Pixel*>(data_.Data()) + Index(0, y);
+}
+
+uint8_t* Image::PlaneRow(int c, int y) {
+    if (layout_ != PixelLayout::Planar) throw std::logic_error("PlaneRow() needs a planar image");
+    return data_.Data() + PlaneIndex(c, 0, y);
+}
+
+const uint8_t* Image::PlaneRow(int c, int y) const {
+    if (layout_ != PixelLayout::Planar) throw std::logic_error("PlaneRow() needs a planar image");
+    return data_.Data() + PlaneIndex(c, 0, y);
+}
+
+void Image::PrepareBorder(int radius) {
+    if (width_ == 0 || height_ == 0) return;
+
+    if (radius > border_) {
+        Image grown(width_, height_, radius, mode_, layout_);
+        grown.CopyRect(*this, 0, 0, 0, 0, width_, height_);
+        *this = std::move(grown);
+    }
+    if (border_ == 0) return;
+
+    if (layout_ == PixelLayout::Packed) {
+        for (int y = 0; y < height_; ++y) FillRowApron(Row(y), width_, border_, mode_);
+        for (int y = -border_; y < 0; ++y) {
+            const Pixel* src = Row(MapBorderIndex(y, height_, mode_)) - border_;
+            std::copy(src, src + GetStride(), Row(y) - border_);
+        }
+        for (int y = height_; y < height_ + border_; ++y) {
+            const Pixel* src = Row(MapBorderIndex(y, height_, mode_)) - border_;
+            std::copy(src, src + GetStride(), Row(y) - border_);
+        }
+        return;
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        for (int y = 0; y < height_; ++y) FillRowApron(PlaneRow(c, y), width_, border_, mode_);
+        for (int y = -border_; y < 0; ++y) {
+            const uint8_t* src = PlaneRow(c, MapBorderIndex(y, height_, mode_)) - border_;
+            std::copy(src, src + GetStride(), PlaneRow(c, y) - border_);
+        }
+        for (int y = height_; y < height_ + border_; ++y) {
+            const uint8_t* src = PlaneRow(c, MapBorderIndex(y, height_, mode_)) - border_;
+            std::copy(src, src + GetStride(), PlaneRow(c, y) - border_);
+        }
+    }
+}
+
+void Image::CopyRect(const Image& src, int sx, int sy, int dx, int dy, int width, int height) {
+    for (int y = 0; y < height; ++y) {
+        if (layout_ == PixelLayout::Packed && src.layout_ == PixelLayout::Packed) {
+            const Pixel* s = src.Row(sy + y) + sx;
+            std::copy(s, s + width, Row(dy + y) + dx);
+        } else if (layout_ == PixelLayout::Planar && src.layout_ == PixelLayout::Planar) {
+            for (int c = 0; c < 3; ++c) {
+                const uint8_t* s = src.PlaneRow(c, sy + y) + sx;
+                std::copy(s, s + width, PlaneRow(c, dy + y) + dx);
+            }
+        } else if (layout_ == PixelLayout::Planar) {
+            const Pixel* s = src.Row(sy + y) + sx;
+            uint8_t* r = PlaneRow(0, dy + y) + dx;
+            uint8_t* g = PlaneRow(1, dy + y) + dx;
+            uint8_t* b = PlaneRow(2, dy + y) + dx;
+            for (int x = 0; x < width; ++x) {
+                r[x] = s[x].r;
+                g[x] = s[x].g;
+                b[x] = s[x].b;
+            }
+        } else {
+            const uint8_t* r = src.PlaneRow(0, sy + y) + sx;
+            const uint8_t* g = src.PlaneRow(1, sy + y) + sx;
+            const uint8_t* b = src.PlaneRow(2, sy + y) + sx;
+            Pixel* d = Row(dy + y) + dx;
+            for (int x = 0; x < width; ++x) d[x] = Pixel{r[x], g[x], b[x]};
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "image_pool.h"
+
+#include <utility>
+
+static thread_local ImagePool* g_current_pool = nullptr;
+
+Image ImagePool::Acquire(int width, int height, int border, BorderMode mode, PixelLayout layout) {
+    const size_t need = Image::StorageBytes(width, height, border, layout);
+    if (need == 0) return Image(width, height, border, mode, layout);
+
+    size_t best = free_.size();
+    for (size_t i = 0; i < free_.size(); ++i) {
+        const size_t capacity = free_[i].GetCapacity();
+        if (capacity < need) continue;
+        if (best == free_.size() || capacity < free_[best].GetCapacity()) best = i;
+    }
+
+    if (best == free_.size()) {
+        free_.clear();
+        return Image(width, height, border, mode, layout);
+    }
+
+    Image image = std::move(free_[best]);
+    free_.erase(free_.begin() + static_cast<std::ptrdiff_t>(best));
+    image.Reshape(width, height, border, mode, layout);
+    return image;
+}
+
+void ImagePool::Release(Image image) {
+    if (image.GetCapacity() != 0) free_.push_back(std::move(image));
+}
+
+void ImagePool::Clear() {
+    free_.clear();
+}
+
+size_t ImagePool::GetIdleBytes() const {
+    size_t bytes = 0;
+    for (const Image& image : free_) bytes += AllocatedBytes(image.GetCapacity());
+    return bytes;
+}
+
+ImagePool::Scope::Scope(ImagePool* pool) : previous_(std::exchange(g_current_pool, pool)) {}
+
+ImagePool::Scope::~Scope() {
+    g_current_pool = previous_;
+}
+
+Image AcquireImage(int width, int height, int border, BorderMode mode, PixelLayout layout) {
+    if (g_current_pool) return g_current_pool->Acquire(width, height, border, mode, layout);
+    return Image(width, height, border, mode, layout);
+}
+
+void RecycleImage(Image image) {
+    if (g_current_pool) g_current_pool->Release(std::move(image));
+}
+
+void ReplaceImage(Image& image, Image next) {
+    std::swap(image, next);
+    RecycleImage(std::move(next));
+}
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include "bmp.h"
 #include "filter_factory.h"
+#include "pipeline.h"
+#include "raw_stream.h"
+#include "spool_queue.h"
+#include "tuning.h"
 
+#include <cstdio>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -12,7 +17,7 @@ int main(int argc, char** argv) {
 
     const std::string exe = (argc > 0) ? args[0] : "imagecraft";
 
-    if (argc < 3) {
+    if (argc < 2 || (argc < 3 && args[1] != "--tune")) {
         PrintUsage(exe);
         return 1;
     }
@@ -23,15 +28,55 @@ int main(int argc, char** argv) {
     }
 
     const std::string input = args[1];
-    const std::string output = args[2];
+    const std::string output = argc > 2 ? args[2] : "";
 
     try {
-        Image img = ReadBmp(input);
-        auto filters = ParseFilters(args, 3);
-        for (const auto& f : filters) {
-            f->Apply(img);
+        if (input == "--tune") {
+            if (argc > 3) throw std::invalid_argument("--tune expects at most <width>x<height>");
+            int width = 1024;
+            int height = 768;
+            if (argc == 3) ParseFrameSize(output, width, height);
+            RunTuner(width, height, TuningProfilePath());
+            return 0;
         }
+
+        PipelineOptions options;
+        LoadTuningProfile(TuningProfilePath(), options);
+        if (input == "--raw-in") {
+            if (argc < 4 || args[3] != "--raw-out") throw std::invalid_argument("--raw-in expects <width>x<height> --raw-out");
+            int width = 0;
+            int height = 0;
+            ParseFrameSize(output, width, height);
+            auto filters = ParseFilters(args, 4, options);
+            SetHugePageAllocation(options.huge_pages);
+            RunRawStream(stdin, stdout, width, height, filters, options);
+            return 0;
+        }
+
+        if (input == "--queue") {
+            double lease_seconds = 60.0;
+            size_t start = 3;
+            if (argc > 4 && args[3] == "--lease") {
+                lease_seconds = ParseLeaseSeconds(args[4]);
+                start = 5;
+            }
+            auto filters = ParseFilters(args, start, options);
+            SetHugePageAllocation(options.huge_pages);
+            return RunQueueWorker(output, lease_seconds, filters, options) == 0 ? 0 : 1;
+        }
+
+        auto filters = ParseFilters(args, 3, options);
+        SetHugePageAllocation(options.huge_pages);
+
+        int width = 0;
+        int height = 0;
+        ReadBmpSize(input, width, height);
+        CheckMemoryBudget(width, height, filters, options);
+
+        Image img = ReadBmp(input, ChooseInputLayout(filters), ChooseInputBorder(filters));
+        RunPipeline(img, filters, options);
         WriteBmp(output, img);
+        if (options.max_memory != 0) ReportMemoryUsage(options);
     } catch (const std::invalid_argument& e) {
         if (std::string(e.what()) == "help") {
             PrintUsage(exe);
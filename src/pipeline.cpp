@@ -0,0 +1,376 @@
+#include "pipeline.h"
+
+#include "image_pool.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#elif defined(__unix__)
+#include <unistd.h>
+#endif
+
+static constexpr size_t kDefaultL2Bytes = 1u << 20;
+static constexpr int kMinTileSize = 64;
+
+// Tile copy, stage output and one stage temporary are live at a time.
+static constexpr size_t kTileBytesPerPixel = 4 * sizeof(Pixel);
+
+static size_t L2CacheBytes() {
+#if defined(__APPLE__)
+    size_t bytes = 0;
+    size_t len = sizeof(bytes);
+    if (sysctlbyname("hw.l2cachesize", &bytes, &len, nullptr, 0) == 0 && bytes > 0) return bytes;
+#elif defined(_SC_LEVEL2_CACHE_SIZE)
+    const long bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (bytes > 0) return static_cast<size_t>(bytes);
+#endif
+    return kDefaultL2Bytes;
+}
+
+static int AutoTileSize(int halo) {
+    const double pixels = static_cast<double>(L2CacheBytes() / kTileBytesPerPixel);
+    const int side = static_cast<int>(std::sqrt(pixels));
+    return std::max(side - 2 * halo, kMinTileSize);
+}
+
+// A fused tile runs every stage over (tile + 2 * halo)^2 pixels to write
+// tile^2, and also pays for copying the tile in and out. By about twice the
+// pixels the stages one at a time over the whole image are already faster
+// (--blur 10 --blur 10 on 1200x900: 0.76 s fused, 0.41 s not), so stop well
+// short of that.
+static constexpr double kMaxTileOverlap = 1.5;
+
+static int FusedTileSize(int halo, const PipelineOptions& options) {
+    return options.tile_size > 0 ? options.tile_size : AutoTileSize(halo);
+}
+
+static bool WorthFusing(int halo, const PipelineOptions& options) {
+    const double tile = FusedTileSize(halo, options);
+    const double ratio = (tile + 2.0 * halo) / tile;
+    return ratio * ratio <= kMaxTileOverlap;
+}
+
+static int ThreadCount(const PipelineOptions& options) {
+    if (options.threads > 0) return options.threads;
+    const unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? static_cast<int>(hw) : 1;
+}
+
+static void RunWhole(Image& image, const Filter& f, BorderMode border, int threads = 1) {
+    if (!f.SupportsLayout(image.GetLayout())) image.ConvertTo(f.GetPreferredLayout());
+    const int halo = f.GetHalo();
+    if (halo > 0) {
+        image.SetBorderMode(border);
+        image.PrepareBorder(halo);
+    }
+    f.ApplyParallel(image, threads);
+}
+
+// A run is either a sequence of local filters, as long as it can be while
+// fusing it stays worthwhile, or one non-local filter. Runs are the unit the
+// scheduler picks a strategy for.
+struct Run {
+    size_t first = 0;
+    size_t last = 0;
+    bool local = false;
+    int halo = 0;
+    int max_halo = 0;
+    int temporaries = 0;
+};
+
+enum class RunStrategy {
+    Whole,
+    Tiled,
+    Banded,
+};
+
+struct RunPlan {
+    RunStrategy strategy = RunStrategy::Whole;
+    int threads = 1;
+    int tile = 0;
+    int band = 0;
+    size_t peak_bytes = 0;
+};
+
+static constexpr int kMaxBandRows = 256;
+static constexpr int kMinBandRows = 8;
+
+static std::vector<Run> SplitRuns(const std::vector<std::unique_ptr<Filter>>& filters,
+                                  const PipelineOptions& options) {
+    std::vector<Run> runs;
+    size_t i = 0;
+    while (i < filters.size()) {
+        Run run;
+        run.first = i;
+        run.local = filters[i]->IsLocal();
+        size_t j = i + 1;
+        int halo = filters[i]->GetHalo();
+        while (run.local && j < filters.size() && filters[j]->IsLocal() &&
+               WorthFusing(halo + filters[j]->GetHalo(), options)) {
+            halo += filters[j]->GetHalo();
+            ++j;
+        }
+        run.last = j;
+        for (size_t k = i; k < j; ++k) {
+            run.halo += filters[k]->GetHalo();
+            run.max_halo = std::max(run.max_halo, filters[k]->GetHalo());
+            run.temporaries = std::max(run.temporaries, filters[k]->GetTemporaryImages());
+        }
+        runs.push_back(run);
+        i = j;
+    }
+    return runs;
+}
+
+static size_t WholeBytes(const std::vector<std::unique_ptr<Filter>>& filters, const Run& run, int w, int h,
+                         PixelLayout layout) {
+    const size_t img = Image::EstimateBytes(w, h, run.max_halo, layout);
+    size_t peak = img;
+    for (size_t i = run.first; i < run.last; ++i) {
+        size_t need = img * static_cast<size_t>(1 + filters[i]->GetTemporaryImages());
+        if (!filters[i]->SupportsLayout(layout)) need = std::max(need, 2 * img);
+        peak = std::max(peak, need);
+    }
+    return peak;
+}
+
+static size_t TiledBytes(const Run& run, int w, int h, PixelLayout layout, int tile, int threads) {
+    const int side = tile + 2 * run.halo;
+    const size_t per_tile = Image::EstimateBytes(side, side, run.max_halo, layout) * static_cast<size_t>(2 + run.temporaries);
+    return 2 * Image::EstimateBytes(w, h, run.max_halo, layout) + static_cast<size_t>(threads) * per_tile;
+}
+
+static size_t BandedBytes(const Run& run, int w, int h, PixelLayout layout, int band) {
+    const size_t band_bytes = Image::EstimateBytes(w, band + 2 * run.halo, run.max_halo, layout);
+    return Image::EstimateBytes(w, h, run.max_halo, layout) + Image::EstimateBytes(w, run.halo, 0, layout) +
+           band_bytes * static_cast<size_t>(2 + run.temporaries);
+}
+
+// Picks the fastest strategy whose estimated peak fits options.max_memory
+// (0 means no limit): tiled with as many threads as allowed, then whole-image,
+// then in-place bands. When nothing fits, returns the smallest estimate.
+static RunPlan PlanRun(const std::vector<std::unique_ptr<Filter>>& filters, const Run& run, int w, int h,
+                       PixelLayout layout, const PipelineOptions& options) {
+    const size_t budget = options.max_memory;
+    auto fits = [&](const RunPlan& p) { return budget == 0 || p.peak_bytes <= budget; };
+    const bool spatial = run.local && options.border != BorderMode::Wrap;
+
+    RunPlan best;
+    best.peak_bytes = WholeBytes(filters, run, w, h, layout);
+
+    if (spatial && options.fuse && run.last - run.first >= 2) {
+        const int tile = FusedTileSize(run.halo, options);
+        if (tile < w || tile < h) {
+            for (int threads = ThreadCount(options); threads >= 1; --threads) {
+                RunPlan p;
+                p.strategy = RunStrategy::Tiled;
+                p.threads = threads;
+                p.tile = tile;
+                p.peak_bytes = TiledBytes(run, w, h, layout, tile, threads);
+                if (fits(p)) return p;
+                if (budget == 0) break;
+            }
+        }
+    }
+
+    if (fits(best)) return best;
+
+    if (spatial) {
+        const int min_band = std::max(run.halo, kMinBandRows);
+        for (int band = std::max(kMaxBandRows, min_band); ; band = std::max(band / 2, min_band)) {
+            RunPlan p;
+            p.strategy = RunStrategy::Banded;
+            p.band = band;
+            p.peak_bytes = BandedBytes(run, w, h, layout, band);
+            if (p.peak_bytes < best.peak_bytes) best = p;
+            if (fits(p) || band == min_band) break;
+        }
+    }
+
+    return best;
+}
+
+static std::string FormatBytes(size_t bytes) {
+    const double mib = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%zu bytes (%.1f MiB)", bytes, mib);
+    return buf;
+}
+
+static void CheckPlan(const RunPlan& plan, int w, int h, const PipelineOptions& options) {
+    if (options.max_memory == 0 || plan.peak_bytes <= options.max_memory) return;
+    throw std::runtime_error("filter chain needs about " + FormatBytes(plan.peak_bytes) + " for a " +
+                             std::to_string(w) + "x" + std::to_string(h) + " image, --max-memory is " +
+                             FormatBytes(options.max_memory));
+}
+
+// Applies filters [first, last) tile by tile. Each tile is read with the
+// accumulated halo of the whole run around it; the overlap is recomputed by
+// neighbouring tiles and only the exact tile is written back. Tile edges that
+// lie on the image edge keep the real border behaviour, which is why wrap
+// mode never reaches here. Each worker reuses its tile and stage buffers
+// through a pool of its own, handed from tile to tile.
+static void RunFused(Image& image, const std::vector<std::unique_ptr<Filter>>& filters, const Run& run,
+                     const RunPlan& plan, const PipelineOptions& options) {
+    const int halo = run.halo;
+    const int max_halo = run.max_halo;
+    const int tile = plan.tile;
+    const size_t first = run.first;
+    const size_t last = run.last;
+
+    const int w = image.GetWidth();
+    const int h = image.GetHeight();
+
+    struct TileOrigin {
+        int x;
+        int y;
+    };
+    std::vector<TileOrigin> tiles;
+    for (int ty = 0; ty < h; ty += tile) {
+        for (int tx = 0; tx < w; tx += tile) tiles.push_back(TileOrigin{tx, ty});
+    }
+
+    Image out = AcquireImage(w, h, image.GetBorder(), options.border, image.GetLayout());
+    std::mutex pools_mu;
+    std::vector<ImagePool> idle_pools;
+    auto run_tile = [&](const TileOrigin& o) {
+        ImagePool pool;
+        {
+            std::lock_guard<std::mutex> lock(pools_mu);
+            if (!idle_pools.empty()) {
+                pool = std::move(idle_pools.back());
+                idle_pools.pop_back();
+            }
+        }
+        const ImagePool::Scope scope(&pool);
+
+        const int ox1 = std::min(o.x + tile, w);
+        const int oy1 = std::min(o.y + tile, h);
+        const int ix0 = std::max(o.x - halo, 0);
+        const int iy0 = std::max(o.y - halo, 0);
+        const int ix1 = std::min(ox1 + halo, w);
+        const int iy1 = std::min(oy1 + halo, h);
+
+        Image t = AcquireImage(ix1 - ix0, iy1 - iy0, max_halo, options.border, image.GetLayout());
+        t.CopyRect(image, ix0, iy0, 0, 0, ix1 - ix0, iy1 - iy0);
+
+        for (size_t i = first; i < last; ++i) RunWhole(t, *filters[i], options.border);
+
+        out.CopyRect(t, o.x - ix0, o.y - iy0, o.x, o.y, ox1 - o.x, oy1 - o.y);
+        pool.Release(std::move(t));
+
+        std::lock_guard<std::mutex> lock(pools_mu);
+        idle_pools.push_back(std::move(pool));
+    };
+
+    ParallelFor(tiles.size(), plan.threads, [&](size_t k) { run_tile(tiles[k]); });
+
+    ReplaceImage(image, std::move(out));
+}
+
+// Applies a run of local filters in full-width bands and writes each band
+// back into `image`, so only one full-size image is alive. The original rows
+// just above the next band are saved before they are overwritten.
+static void RunBanded(Image& image, const std::vector<std::unique_ptr<Filter>>& filters, const Run& run,
+                      const RunPlan& plan, const PipelineOptions& options) {
+    const int w = image.GetWidth();
+    const int h = image.GetHeight();
+    const int halo = run.halo;
+    const int band = std::max(plan.band, std::max(halo, 1));
+
+    Image saved = AcquireImage(w, halo, 0, options.border, image.GetLayout());
+    for (int y0 = 0; y0 < h; y0 += band) {
+        const int y1 = std::min(y0 + band, h);
+        const int iy0 = std::max(y0 - halo, 0);
+        const int iy1 = std::min(y1 + halo, h);
+
+        Image t = AcquireImage(w, iy1 - iy0, run.max_halo, options.border, image.GetLayout());
+        t.CopyRect(saved, 0, halo - (y0 - iy0), 0, 0, w, y0 - iy0);
+        t.CopyRect(image, 0, y0, 0, y0 - iy0, w, iy1 - y0);
+
+        for (size_t i = run.first; i < run.last; ++i) RunWhole(t, *filters[i], options.border);
+
+        const int sy0 = std::max(y1 - halo, 0);
+        saved.CopyRect(image, 0, sy0, 0, halo - (y1 - sy0), w, y1 - sy0);
+        image.CopyRect(t, 0, y0 - iy0, 0, y0, w, y1 - y0);
+        RecycleImage(std::move(t));
+    }
+    RecycleImage(std::move(saved));
+}
+
+void RunPipeline(Image& image, const std::vector<std::unique_ptr<Filter>>& filters, const PipelineOptions& options,
+                 ImagePool* pool) {
+    ImagePool local;
+    ImagePool& scratch = pool ? *pool : local;
+    const ImagePool::Scope scope(&scratch);
+    for (const Run& run : SplitRuns(filters, options)) {
+        const int w = image.GetWidth();
+        const int h = image.GetHeight();
+        const RunPlan plan = PlanRun(filters, run, w, h, image.GetLayout(), options);
+        CheckPlan(plan, w, h, options);
+        // The plan covers every image the run allocates, and each of them
+        // may instead come from an idle buffer, so idle plus planned bytes
+        // bound the run. Keep the idle buffers only while that fits.
+        if (options.max_memory != 0 && plan.peak_bytes + scratch.GetIdleBytes() > options.max_memory) scratch.Clear();
+
+        switch (plan.strategy) {
+        case RunStrategy::Tiled:
+            RunFused(image, filters, run, plan, options);
+            break;
+        case RunStrategy::Banded:
+            RunBanded(image, filters, run, plan, options);
+            break;
+        case RunStrategy::Whole:
+            for (size_t i = run.first; i < run.last; ++i) {
+                RunWhole(image, *filters[i], options.border, ThreadCount(options));
+            }
+            break;
+        }
+    }
+}
+
+size_t EstimatePeakBytes(int width, int height, const std::vector<std::unique_ptr<Filter>>& filters,
+                         const PipelineOptions& options) {
+    const PixelLayout layout = ChooseInputLayout(filters);
+    size_t peak = Image::EstimateBytes(width, height, ChooseInputBorder(filters), layout);
+    for (const Run& run : SplitRuns(filters, options)) {
+        peak = std::max(peak, PlanRun(filters, run, width, height, layout, options).peak_bytes);
+    }
+    return peak;
+}
+
+void CheckMemoryBudget(int width, int height, const std::vector<std::unique_ptr<Filter>>& filters,
+                       const PipelineOptions& options) {
+    if (options.max_memory == 0) return;
+    RunPlan plan;
+    plan.peak_bytes = EstimatePeakBytes(width, height, filters, options);
+    CheckPlan(plan, width, height, options);
+}
+
+void ReportMemoryUsage(const PipelineOptions& options) {
+    std::cerr << "Peak image memory: " << FormatBytes(GetMemoryUsage().peak);
+    if (options.max_memory != 0) std::cerr << " of " << FormatBytes(options.max_memory) << " allowed";
+    std::cerr << "\n";
+}
+
+int ChooseInputBorder(const std::vector<std::unique_ptr<Filter>>& filters) {
+    int border = 0;
+    for (const auto& f : filters) border = std::max(border, f->GetHalo());
+    return border;
+}
+
+PixelLayout ChooseInputLayout(const std::vector<std::unique_ptr<Filter>>& filters) {
+    for (const auto& f : filters) {
+        if (f->GetHalo() > 0) return f->GetPreferredLayout();
+    }
+    return PixelLayout::Packed;
+}
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "raw_stream.h"
+
+#include "frame_queue.h"
+#include "image_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// Frames in flight between reader, filters and writer. Also bounds the
+// latency added by queueing to this many frame times.
+static constexpr size_t kFramesInFlight = 3;
+
+void ParseFrameSize(const std::string& s, int& width, int& height) {
+    const size_t sep = s.find('x');
+    if (sep == std::string::npos) throw std::invalid_argument("bad frame size: " + s);
+
+    const std::string ws = s.substr(0, sep);
+    const std::string hs = s.substr(sep + 1);
+    char* end = nullptr;
+    const long w = std::strtol(ws.c_str(), &end, 10);
+    if (ws.empty() || *end != '\0') throw std::invalid_argument("bad frame size: " + s);
+    const long h = std::strtol(hs.c_str(), &end, 10);
+    if (hs.empty() || *end != '\0') throw std::invalid_argument("bad frame size: " + s);
+    if (w <= 0 || h <= 0 || w > std::numeric_limits<int>::max() / 3 || h > std::numeric_limits<int>::max()) {
+        throw std::invalid_argument("bad frame size: " + s);
+    }
+
+    width = static_cast<int>(w);
+    height = static_cast<int>(h);
+}
+
+// Returns false on a clean end of input before the first byte of a frame.
+static bool ReadFrame(std::FILE* in, Image& img, std::vector<uint8_t>& row) {
+    const int w = img.GetWidth();
+    const int h = img.GetHeight();
+    const size_t row_bytes = static_cast<size_t>(w) * 3;
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t* dst = img.GetLayout() == PixelLayout::Packed ? reinterpret_cast<uint8_t*>(img.Row(y)) : row.data();
+        const size_t got = std::fread(dst, 1, row_bytes, in);
+        if (got != row_bytes) {
+            if (y == 0 && got == 0 && std::feof(in)) return false;
+            throw std::runtime_error("truncated raw frame");
+        }
+
+        if (img.GetLayout() == PixelLayout::Planar) {
+            uint8_t* pr = img.PlaneRow(0, y);
+            uint8_t* pg = img.PlaneRow(1, y);
+            uint8_t* pb = img.PlaneRow(2, y);
+            for (int x = 0; x < w; ++x) {
+                pr[x] = row[static_cast<size_t>(x * 3 + 0)];
+                pg[x] = row[static_cast<size_t>(x * 3 + 1)];
+                pb[x] = row[static_cast<size_t>(x * 3 + 2)];
+            }
+        }
+    }
+    return true;
+}
+
+static void WriteFrame(std::FILE* out, const Image& img, std::vector<uint8_t>& row) {
+    const int w = img.GetWidth();
+    const int h = img.GetHeight();
+    const size_t row_bytes = static_cast<size_t>(w) * 3;
+    row.resize(row_bytes);
+
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* src = nullptr;
+        if (img.GetLayout() == PixelLayout::Packed) {
+            src = reinterpret_cast<const uint8_t*>(img.Row(y));
+        } else {
+            const uint8_t* pr = img.PlaneRow(0, y);
+            const uint8_t* pg = img.PlaneRow(1, y);
+            const uint8_t* pb = img.PlaneRow(2, y);
+            for (int x = 0; x < w; ++x) {
+                row[static_cast<size_t>(x * 3 + 0)] = pr[x];
+                row[static_cast<size_t>(x * 3 + 1)] = pg[x];
+                row[static_cast<size_t>(x * 3 + 2)] = pb[x];
+            }
+            src = row.data();
+        }
+        if (std::fwrite(src, 1, row_bytes, out) != row_bytes) throw std::runtime_error("failed to write raw frame");
+    }
+    if (std::fflush(out) != 0) throw std::runtime_error("failed to write raw frame");
+}
+
+void RunRawStream(std::FILE* in, std::FILE* out, int width, int height,
+                  const std::vector<std::unique_ptr<Filter>>& filters, const PipelineOptions& options) {
+    if (width <= 0 || height <= 0) throw std::invalid_argument("invalid raw frame size");
+
+    const PixelLayout layout = ChooseInputLayout(filters);
+    const int border = ChooseInputBorder(filters);
+
+    // Under a memory budget, frames waiting in the queues come out of what
+    // the pipeline may use; keep fewer of them in flight if needed.
+    size_t in_flight = kFramesInFlight;
+    PipelineOptions pipe = options;
+    if (options.max_memory != 0) {
+        const size_t frame = Image::EstimateBytes(width, height, border, layout);
+        for (; in_flight > 1; --in_flight) {
+            const size_t queued = (in_flight - 1) * frame;
+            if (queued >= options.max_memory) continue;
+            pipe.max_memory = options.max_memory - queued;
+            if (EstimatePeakBytes(width, height, filters, pipe) <= pipe.max_memory) break;
+        }
+        if (in_flight == 1) pipe.max_memory = options.max_memory;
+        CheckMemoryBudget(width, height, filters, pipe);
+    }
+
+    FrameQueue<Image> free_frames(in_flight);
+    FrameQueue<Image> decoded(in_flight);
+    FrameQueue<Image> processed(in_flight);
+    for (size_t i = 0; i < in_flight; ++i) {
+        free_frames.Push(Image(width, height, border, options.border, layout));
+    }
+
+    std::mutex error_mu;
+    std::exception_ptr error;
+    auto fail = [&](std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(error_mu);
+            if (!error) error = e;
+        }
+        free_frames.Close();
+        decoded.Close();
+        processed.Close();
+    };
+
+    std::thread reader([&] {
+        try {
+            std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+            Image img;
+            while (free_frames.Pop(img)) {
+                // A chain that changes the frame size returns frames that no
+                // longer fit the input; reshape or replace those.
+                if (img.GetWidth() != width || img.GetHeight() != height || img.GetLayout() != layout ||
+                    img.GetBorder() != border) {
+                    if (!img.Reshape(width, height, border, options.border, layout)) {
+                        img = Image(width, height, border, options.border, layout);
+                    }
+                }
+                if (!ReadFrame(in, img, row)) break;
+                if (!decoded.Push(std::move(img))) break;
+            }
+            decoded.Close();
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    });
+
+    std::thread writer([&] {
+        try {
+            std::vector<uint8_t> row;
+            Image img;
+            while (processed.Pop(img)) {
+                WriteFrame(out, img, row);
+                free_frames.Push(std::move(img));
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    });
+
+    try {
+        // Frames trade buffers with this pool as they pass through the
+        // filters, so a steady stream allocates nothing after warm-up.
+        ImagePool scratch;
+        const size_t frame_bytes = Image::StorageBytes(width, height, border, layout);
+        Image img;
+        while (decoded.Pop(img)) {
+            RunPipeline(img, filters, pipe, &scratch);
+
+            // A chain that shrinks frames leaves them in buffers too small
+            // to read the next frame into: move the result into the input
+            // buffer it just released.
+            if (img.GetCapacity() < frame_bytes) {
+                Image frame = scratch.Acquire(width, height, border, options.border, layout);
+                frame.Reshape(img.GetWidth(), img.GetHeight(), img.GetBorder(), img.GetBorderMode(), img.GetLayout());
+                frame.CopyRect(img, 0, 0, 0, 0, img.GetWidth(), img.GetHeight());
+                scratch.Release(std::exchange(img, std::move(frame)));
+            }
+            if (!processed.Push(std::move(img))) break;
+        }
+        processed.Close();
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    writer.join();
+    free_frames.Close();
+    reader.join();
+
+    if (error) std::rethrow_exception(error);
+    if (options.max_memory != 0) ReportMemoryUsage(options);
+}
\ No newline at end of file
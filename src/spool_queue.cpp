@@ -0,0 +1,284 @@
+#include "spool_queue.h"
+
+#include "bmp.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const std::string kLeaseSuffix = ".lease";
+
+struct Spool {
+    fs::path incoming;
+    fs::path work;
+    fs::path done;
+    fs::path failed;
+};
+
+double ParseLeaseSeconds(const std::string& s) {
+    char* end = nullptr;
+    const double v = std::strtod(s.c_str(), &end);
+    if (s.empty() || *end != '\0' || !(v > 0.0 && v <= kMaxLeaseSeconds)) {
+        throw std::invalid_argument("bad lease seconds: " + s);
+    }
+    return v;
+}
+
+// host-pid: unique among live workers and free of '~', so the job name can
+// be recovered from a claimed file name.
+static std::string WorkerId() {
+#if defined(__unix__) || defined(__APPLE__)
+    char host[256]{};
+    if (gethostname(host, sizeof(host) - 1) != 0 || host[0] == '\0') host[0] = '?';
+    std::string id = std::string(host) + "-" + std::to_string(getpid());
+#else
+    std::string id = "worker-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+#endif
+    std::replace(id.begin(), id.end(), '~', '-');
+    return id;
+}
+
+static bool EndsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Regular files in `dir`, sorted. Entries vanishing mid-scan are expected.
+static std::vector<std::string> ListFiles(const fs::path& dir) {
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code type_ec;
+        if (it->is_regular_file(type_ec)) names.push_back(it->path().filename().string());
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static bool IsJob(const std::string& name) {
+    return !name.empty() && name[0] != '.' && !EndsWith(name, kLeaseSuffix);
+}
+
+static bool HasJobs(const fs::path& dir) {
+    const std::vector<std::string> names = ListFiles(dir);
+    return std::any_of(names.begin(), names.end(), IsJob);
+}
+
+static bool Expired(const fs::path& p, double lease_seconds) {
+    std::error_code ec;
+    const fs::file_time_type touched = fs::last_write_time(p, ec);
+    if (ec) return false;
+    const std::chrono::duration<double> age = fs::file_time_type::clock::now() - touched;
+    return age.count() > lease_seconds;
+}
+
+// Renames `from` to `to` unless `to` exists, failing with file_exists then.
+// renameat2 does this atomically; where it is missing or the file system
+// lacks support, a hard link (which never replaces) plus unlink does it.
+static bool MoveNoReplace(const fs::path& from, const fs::path& to, std::error_code& ec) {
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    if (renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0) {
+        ec.clear();
+        return true;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        ec.assign(errno, std::generic_category());
+        return false;
+    }
+#endif
+    fs::create_hard_link(from, to, ec);
+    if (ec) return false;
+    fs::remove(from, ec);
+    return true;
+}
+
+// Puts the jobs of workers whose lease expired back into incoming/. Several
+// workers may race here: only one move of a claimed file can succeed. A job
+// resubmitted under the same name is never overwritten; the expired lease
+// is kept so the old job goes back once the name is free. Output
+// temporaries those workers left behind are removed as well.
+static void ReclaimExpired(const Spool& spool, double lease_seconds) {
+    for (const std::string& name : ListFiles(spool.work)) {
+        if (!EndsWith(name, kLeaseSuffix) || !Expired(spool.work / name, lease_seconds)) continue;
+
+        const std::string claimed = name.substr(0, name.size() - kLeaseSuffix.size());
+        const std::string job = claimed.substr(0, claimed.rfind('~'));
+        std::error_code ec;
+        if (MoveNoReplace(spool.work / claimed, spool.incoming / job, ec)) {
+            std::cerr << "reclaimed " << job << " from expired lease " << name << "\n";
+        } else if (ec == std::errc::file_exists) {
+            continue;
+        }
+        fs::remove(spool.work / name, ec);
+    }
+
+    for (const std::string& name : ListFiles(spool.done)) {
+        if (name[0] != '.' || !Expired(spool.done / name, lease_seconds)) continue;
+        std::error_code ec;
+        fs::remove(spool.done / name, ec);
+    }
+}
+
+// Claims one job from incoming/. The lease is written before the rename, so
+// a claimed job is never without one; a lease whose rename lost the race is
+// removed again. Workers start scanning at different offsets to spread out.
+static bool ClaimNext(const Spool& spool, const std::string& worker, std::string& job) {
+    std::vector<std::string> names = ListFiles(spool.incoming);
+    names.erase(std::remove_if(names.begin(), names.end(), [](const std::string& n) { return !IsJob(n); }),
+                names.end());
+    if (names.empty()) return false;
+
+    const size_t first = std::hash<std::string>{}(worker) % names.size();
+    for (size_t i = 0; i < names.size(); ++i) {
+        const std::string& name = names[(first + i) % names.size()];
+        const std::string claimed = name + "~" + worker;
+        const fs::path lease = spool.work / (claimed + kLeaseSuffix);
+        {
+            std::ofstream out(lease);
+            out << worker << "\n";
+            if (!out) throw std::runtime_error("cannot write lease " + lease.string());
+        }
+
+        std::error_code ec;
+        fs::rename(spool.incoming / name, spool.work / claimed, ec);
+        if (!ec) {
+            job = name;
+            return true;
+        }
+        fs::remove(lease, ec);
+    }
+    return false;
+}
+
+// Touches a lease file from a background thread for as long as it lives.
+class LeaseKeeper {
+public:
+    LeaseKeeper(fs::path lease, std::chrono::milliseconds interval)
+        : lease_(std::move(lease)), interval_(interval), thread_([this] { Run(); }) {}
+
+    ~LeaseKeeper() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    LeaseKeeper(const LeaseKeeper&) = delete;
+    LeaseKeeper& operator=(const LeaseKeeper&) = delete;
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (!cv_.wait_for(lock, interval_, [&] { return stop_; })) {
+            std::error_code ec;
+            fs::last_write_time(lease_, fs::file_time_type::clock::now(), ec);
+        }
+    }
+
+    fs::path lease_;
+    std::chrono::milliseconds interval_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+static void ProcessJob(const fs::path& input, const fs::path& output,
+                       const std::vector<std::unique_ptr<Filter>>& filters, const PipelineOptions& options) {
+    int width = 0;
+    int height = 0;
+    ReadBmpSize(input.string(), width, height);
+    CheckMemoryBudget(width, height, filters, options);
+
+    Image img = ReadBmp(input.string(), ChooseInputLayout(filters), ChooseInputBorder(filters));
+    RunPipeline(img, filters, options);
+    WriteBmp(output.string(), img);
+}
+
+static void WriteNote(const fs::path& path, const std::string& text) {
+    const fs::path tmp = path.parent_path() / ("." + path.filename().string() + ".tmp");
+    {
+        std::ofstream out(tmp);
+        out << text << "\n";
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+}
+
+int RunQueueWorker(const std::string& dir, double lease_seconds, const std::vector<std::unique_ptr<Filter>>& filters,
+                   const PipelineOptions& options) {
+    if (!(lease_seconds > 0.0 && lease_seconds <= kMaxLeaseSeconds)) {
+        throw std::invalid_argument("lease must be > 0 seconds and at most a week");
+    }
+
+    const fs::path root(dir);
+    const Spool spool{root / "incoming", root / "work", root / "done", root / "failed"};
+    for (const fs::path* d : {&spool.incoming, &spool.work, &spool.done, &spool.failed}) fs::create_directories(*d);
+
+    const std::string worker = WorkerId();
+    // Renew well within the lease so one late wake-up does not lose it.
+    const auto heartbeat = std::chrono::milliseconds(std::max(1L, static_cast<long>(lease_seconds * 250.0)));
+    const auto poll = std::min(heartbeat, std::chrono::milliseconds(1000));
+
+    int processed = 0;
+    int failed = 0;
+    for (;;) {
+        ReclaimExpired(spool, lease_seconds);
+
+        std::string job;
+        if (!ClaimNext(spool, worker, job)) {
+            // Jobs still in work/ may yet come back if their worker dies.
+            if (!HasJobs(spool.incoming) && !HasJobs(spool.work)) break;
+            std::this_thread::sleep_for(poll);
+            continue;
+        }
+
+        const std::string claimed = job + "~" + worker;
+        const fs::path lease = spool.work / (claimed + kLeaseSuffix);
+        const fs::path tmp = spool.done / ("." + claimed + ".tmp");
+        std::error_code ec;
+        try {
+            LeaseKeeper keeper(lease, heartbeat);
+            ProcessJob(spool.work / claimed, tmp, filters, options);
+            fs::rename(tmp, spool.done / job);
+            fs::remove(spool.work / claimed, ec);
+            ++processed;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: job " << job << ": " << e.what() << "\n";
+            fs::remove(tmp, ec);
+            // If the lease ran out meanwhile, another worker has put the job
+            // back and this failure is not the verdict. Should the claimed
+            // file still be here, its lease is kept so it is reclaimed.
+            fs::rename(spool.work / claimed, spool.failed / job, ec);
+            if (ec) {
+                std::cerr << "job " << job << " not marked failed: " << ec.message() << "\n";
+                continue;
+            }
+            WriteNote(spool.failed / (job + ".error"), e.what());
+            ++failed;
+        }
+        fs::remove(lease, ec);
+    }
+
+    std::cerr << "worker " << worker << ": " << processed << " done, " << failed << " failed\n";
+    return failed;
+}
@@ -0,0 +1,342 @@
+#include "tuning.h"
+
+#include "filter_factory.h"
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+BlurVariant ChooseBlurVariant(const TuningProfile& profile, double sigma) {
+    if (profile.recursive_blur_min_sigma > 0.0 && sigma >= profile.recursive_blur_min_sigma) {
+        return BlurVariant::Recursive;
+    }
+    return BlurVariant::Fir;
+}
+
+MedianVariant ChooseMedianVariant(const TuningProfile& profile, int radius) {
+    if (radius == 1 && profile.network_median) return MedianVariant::Network;
+    if (profile.histogram_median_min_radius > 0 && radius >= profile.histogram_median_min_radius) {
+        return MedianVariant::Histogram;
+    }
+    return MedianVariant::Select;
+}
+
+static std::string HostName() {
+#if defined(__unix__) || defined(__APPLE__)
+    char name[256]{};
+    if (gethostname(name, sizeof(name) - 1) == 0 && name[0] != '\0') return name;
+#endif
+    return "default";
+}
+
+std::string TuningProfilePath() {
+    if (const char* path = std::getenv("IMAGECRAFT_PROFILE")) return path;
+    const char* home = std::getenv("HOME");
+    if (!home || home[0] == '\0') return "";
+    return std::string(home) + "/.imagecraft/" + HostName() + ".profile";
+}
+
+template <typename T>
+static T ReadValue(std::istringstream& in, const std::string& key) {
+    T v{};
+    if (!(in >> v) || v < T{}) throw std::runtime_error("bad value for " + key);
+    return v;
+}
+
+bool LoadTuningProfile(const std::string& path, PipelineOptions& options) {
+    if (path.empty()) return false;
+    std::ifstream in(path);
+    if (!in) return false;
+
+    TuningProfile profile;
+    try {
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string key;
+            if (!(fields >> key) || key[0] == '#') continue;
+            if (key == "threads") profile.threads = ReadValue<int>(fields, key);
+            else if (key == "tile") profile.tile_size = ReadValue<int>(fields, key);
+            else if (key == "blur_recursive_min_sigma") profile.recursive_blur_min_sigma = ReadValue<double>(fields, key);
+            else if (key == "median_network") profile.network_median = ReadValue<int>(fields, key) != 0;
+            else if (key == "median_histogram_min_radius") profile.histogram_median_min_radius = ReadValue<int>(fields, key);
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Warning: ignoring tuning profile " << path << ": " << e.what() << "\n";
+        return false;
+    }
+
+    options.tuning = profile;
+    options.threads = profile.threads;
+    options.tile_size = profile.tile_size;
+    return true;
+}
+
+void SaveTuningProfile(const std::string& path, const TuningProfile& profile) {
+    if (path.empty()) throw std::runtime_error("no tuning profile path (set HOME or IMAGECRAFT_PROFILE)");
+
+    const std::filesystem::path target(path);
+    if (target.has_parent_path()) std::filesystem::create_directories(target.parent_path());
+
+    // Written aside and renamed so concurrent runs never load half a profile.
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        if (!out) throw std::runtime_error("cannot write tuning profile " + tmp);
+        out << "# imagecraft tuning profile for " << HostName() << "\n"
+            << "threads " << profile.threads << "\n"
+            << "tile " << profile.tile_size << "\n"
+            << "blur_recursive_min_sigma " << profile.recursive_blur_min_sigma << "\n"
+            << "median_network " << (profile.network_median ? 1 : 0) << "\n"
+            << "median_histogram_min_radius " << profile.histogram_median_min_radius << "\n";
+        if (!out) throw std::runtime_error("failed to write tuning profile " + tmp);
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) throw std::runtime_error("cannot replace tuning profile " + path);
+}
+
+static constexpr int kRepeats = 5;
+static constexpr double kLongRunSeconds = 0.5;
+static constexpr int kMaxTunedRadius = 5;
+// Largest per-channel difference from the FIR blur the tuner accepts.
+static constexpr int kMaxRecursiveBlurError = 8;
+
+static constexpr int kStepBlockSize = 8;
+
+// Smooth gradients with noise on top, so the median and threshold filters
+// see realistic value spreads rather than a constant. The bottom quarter is
+// blocks of full-contrast colour instead: approximate blurs are furthest off
+// at hard step edges, and the blur error gate has to see them.
+static Image SyntheticImage(int w, int h) {
+    Image img(w, h);
+    uint32_t state = 2463534242u;
+    auto next = [&state] {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    for (int y = 0; y < h - h / 4; ++y) {
+        Pixel* row = img.Row(y);
+        for (int x = 0; x < w; ++x) {
+            const int noise = static_cast<int>(next() & 63) - 32;
+            row[x] = Pixel{static_cast<uint8_t>(std::clamp(x * 255 / std::max(w - 1, 1) + noise, 0, 255)),
+                           static_cast<uint8_t>(std::clamp(y * 255 / std::max(h - 1, 1) + noise, 0, 255)),
+                           static_cast<uint8_t>(std::clamp(((x ^ y) & 255) + noise, 0, 255))};
+        }
+    }
+    for (int by = h - h / 4; by < h; by += kStepBlockSize) {
+        for (int bx = 0; bx < w; bx += kStepBlockSize) {
+            const uint32_t bits = next();
+            const Pixel colour{static_cast<uint8_t>(bits & 1 ? 255 : 0), static_cast<uint8_t>(bits & 2 ? 255 : 0),
+                               static_cast<uint8_t>(bits & 4 ? 255 : 0)};
+            for (int y = by; y < std::min(by + kStepBlockSize, h); ++y) {
+                Pixel* row = img.Row(y);
+                std::fill(row + bx, row + std::min(bx + kStepBlockSize, w), colour);
+            }
+        }
+    }
+    return img;
+}
+
+// The input staged the way main decodes it for `filters`.
+static Image StageInput(const Image& source, const std::vector<std::unique_ptr<Filter>>& filters) {
+    const int w = source.GetWidth();
+    const int h = source.GetHeight();
+    Image img(w, h, ChooseInputBorder(filters), BorderMode::Clamp, ChooseInputLayout(filters));
+    img.CopyRect(source, 0, 0, 0, 0, w, h);
+    return img;
+}
+
+// Best wall time in seconds of running the chain parsed from `args`, with
+// the staging outside the timed region. A chain slower than kLongRunSeconds
+// is timed once.
+static double TimeChain(const Image& source, const std::vector<std::string>& args, PipelineOptions options) {
+    const auto filters = ParseFilters(args, 0, options);
+
+    double best = std::numeric_limits<double>::infinity();
+    for (int rep = 0; rep < kRepeats; ++rep) {
+        Image img = StageInput(source, filters);
+
+        const auto start = std::chrono::steady_clock::now();
+        RunPipeline(img, filters, options);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+        if (elapsed.count() > kLongRunSeconds) break;
+    }
+    return best;
+}
+
+static Image RunChain(const Image& source, const std::vector<std::string>& args, PipelineOptions options) {
+    const auto filters = ParseFilters(args, 0, options);
+    Image img = StageInput(source, filters);
+    RunPipeline(img, filters, options);
+    return img;
+}
+
+// Largest difference of any channel of any pixel; both images must have the
+// same size.
+static int MaxDifference(const Image& a, const Image& b) {
+    int worst = 0;
+    for (int y = 0; y < a.GetHeight(); ++y) {
+        for (int x = 0; x < a.GetWidth(); ++x) {
+            const Pixel p = a.GetPixel(x, y);
+            const Pixel q = b.GetPixel(x, y);
+            worst = std::max({worst, std::abs(p.r - q.r), std::abs(p.g - q.g), std::abs(p.b - q.b)});
+        }
+    }
+    return worst;
+}
+
+static std::string Join(const std::vector<std::string>& args) {
+    std::string s;
+    for (const std::string& a : args) s += (s.empty() ? "" : " ") + a;
+    return s;
+}
+
+static std::string FormatNumber(double v) {
+    std::ostringstream s;
+    s << v;
+    return s.str();
+}
+
+static void PrintTime(const std::string& label, double seconds) {
+    std::cout << "  " << std::left << std::setw(34) << label << std::right << std::setw(10) << std::fixed
+              << std::setprecision(2) << seconds * 1e3 << " ms\n" << std::defaultfloat;
+}
+
+static std::vector<int> ThreadCandidates() {
+    const unsigned hw = std::thread::hardware_concurrency();
+    const int max_threads = hw > 0 ? static_cast<int>(hw) : 1;
+    std::vector<int> counts;
+    for (int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+// The recursive blur only runs from sigma 3 up (narrower ones stay FIR),
+// and is only chosen where it is both faster and close enough to FIR.
+static double TuneBlur(const Image& source) {
+    std::cout << "blur (fir / recursive):\n";
+    const double sigmas[] = {3.0, 4.0, 5.0, 8.0, 12.0};
+    std::vector<bool> recursive_wins;
+    for (double sigma : sigmas) {
+        const std::vector<std::string> args{"--blur", FormatNumber(sigma)};
+        PipelineOptions options;
+        const double fir = TimeChain(source, args, options);
+        const Image fir_out = RunChain(source, args, options);
+        options.tuning.recursive_blur_min_sigma = sigma;
+        const double recursive = TimeChain(source, args, options);
+        const int error = MaxDifference(fir_out, RunChain(source, args, options));
+        PrintTime("sigma " + args[1] + " fir", fir);
+        PrintTime("sigma " + args[1] + " recursive (max error " + std::to_string(error) + ")", recursive);
+        recursive_wins.push_back(recursive < fir && error <= kMaxRecursiveBlurError);
+    }
+
+    // The recursive cost is flat in sigma while the FIR cost grows, so it
+    // qualifies from some sigma up; one sigma that fails the error gate rules
+    // out every smaller one too.
+    double threshold = 0.0;
+    for (size_t i = recursive_wins.size(); i-- > 0 && recursive_wins[i];) threshold = sigmas[i];
+    return threshold;
+}
+
+static void TuneMedian(const Image& source, TuningProfile& profile) {
+    std::cout << "median (select / network / histogram):\n";
+    for (int r = 1; r <= kMaxTunedRadius; ++r) {
+        const std::vector<std::string> args{"--med", std::to_string(r)};
+        PipelineOptions options;
+        const double select = TimeChain(source, args, options);
+        options.tuning.histogram_median_min_radius = r;
+        const double histogram = TimeChain(source, args, options);
+        PrintTime("radius " + args[1] + " select", select);
+        PrintTime("radius " + args[1] + " histogram", histogram);
+
+        if (r == 1) {
+            options.tuning = TuningProfile{};
+            options.tuning.network_median = true;
+            const double network = TimeChain(source, args, options);
+            PrintTime("radius 1 network", network);
+            profile.network_median = network < std::min(select, histogram);
+        }
+        if (histogram < select) {
+            profile.histogram_median_min_radius = r;
+            return;
+        }
+    }
+}
+
+void RunTuner(int width, int height, const std::string& path) {
+    if (width <= 0 || height <= 0) throw std::invalid_argument("tuning image size must be positive");
+    const Image source = SyntheticImage(width, height);
+    TuningProfile profile;
+    std::cout << "tuning on a " << width << "x" << height << " synthetic image\n";
+
+    profile.recursive_blur_min_sigma = TuneBlur(source);
+    TuneMedian(source, profile);
+
+    // Threads and tiles only matter for fused runs, so they are tuned on a
+    // chain of every local filter, already using the chosen kernels.
+    const std::vector<std::string> chain{"--gamma", "0.9", "--blur", "1.5", "--sharp", "--med", "1",
+                                         "--conv", "3", "1", "2", "1", "2", "4", "2", "1", "2", "1"};
+    std::cout << "threads (" << Join(chain) << "):\n";
+    PipelineOptions options;
+    options.tuning = profile;
+    double best = std::numeric_limits<double>::infinity();
+    for (int threads : ThreadCandidates()) {
+        options.threads = threads;
+        const double t = TimeChain(source, chain, options);
+        PrintTime(std::to_string(threads) + " threads", t);
+        if (t < best) {
+            best = t;
+            profile.threads = threads;
+        }
+    }
+
+    std::cout << "tile size:\n";
+    options.threads = profile.threads;
+    best = std::numeric_limits<double>::infinity();
+    for (int tile : {64, 96, 128, 192, 256, 384, 512}) {
+        options.tile_size = tile;
+        const double t = TimeChain(source, chain, options);
+        PrintTime("tile " + std::to_string(tile), t);
+        if (t < best) {
+            best = t;
+            profile.tile_size = tile;
+        }
+    }
+
+    std::cout << "all filters with the chosen settings:\n";
+    options.tuning = profile;
+    options.tile_size = profile.tile_size;
+    const std::vector<std::vector<std::string>> filters{
+        {"--crop", std::to_string(std::max(width / 2, 1)), std::to_string(std::max(height / 2, 1))},
+        {"--gs"}, {"--neg"}, {"--sharp"}, {"--edge", "0.2"}, {"--canny", "1.5", "0.05", "0.15"},
+        {"--blur", "2"}, {"--blur", "8"},
+        {"--med", "1"}, {"--med", "3"}, {"--gamma", "0.8"}, {"--histeq"},
+        {"--conv", "3", "0", "-1", "0", "-1", "5", "-1", "0", "-1", "0"}};
+    for (const auto& args : filters) PrintTime(Join(args), TimeChain(source, args, options));
+
+    SaveTuningProfile(path, profile);
+    std::cout << "saved profile to " << path << ":\n"
+              << "  threads " << profile.threads << ", tile " << profile.tile_size
+              << ", recursive blur from sigma " << profile.recursive_blur_min_sigma
+              << ", network median " << (profile.network_median ? "on" : "off")
+              << ", histogram median from radius " << profile.histogram_median_min_radius << "\n";
+}